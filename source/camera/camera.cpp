@@ -1,9 +1,12 @@
 #include "camera.h"
 
-#include "core/rng.h"
 #include "core/rtiow.h"
+#include "core/sampler.h"
+#include "core/sampling.h"
 
-Camera::Camera(const CreateInfo& createInfo, double aspectRatio)
+#include <algorithm>
+
+Camera::Camera(const CreateInfo& createInfo, double aspectRatio, uint32_t imageHeight)
 {
     w_ = normalize(createInfo.target - createInfo.position);
     u_ = normalize(cross(w_, createInfo.vup));
@@ -18,14 +21,35 @@ Camera::Camera(const CreateInfo& createInfo, double aspectRatio)
     vertical_ = createInfo.focalDistance * viewportHeight * v_;
     lowerLeftCorner_ = position_ - horizontal_ / 2.0 - vertical_ / 2.0 + createInfo.focalDistance * w_;
     lensRadius_ = createInfo.aperature * 0.5;
+    pixelSpread_ = viewportHeight / std::max(imageHeight, 1u);
     timeBegin_ = createInfo.timeBegin;
     timeEnd_ = createInfo.timeEnd;
 }
 
-Ray Camera::createRay(Rng& rng, double s, double t) const
+Ray Camera::createRay(Sampler& sampler, double s, double t) const
 {
-    Vec3 rd = lensRadius_ * rng.inUnitDisk();
+    Vec3 rd = lensRadius_ * squareToConcentricDisk(sampler(), sampler());
     Vec3 offset = u_ * rd.x + v_ * rd.y;
-    double time = rng(timeBegin_, timeEnd_);
-    return Ray(position_ + offset, normalize(lowerLeftCorner_ + s * horizontal_ + t * vertical_ - position_ - offset), time, true, &rng);
+    double time = sampler(timeBegin_, timeEnd_);
+    Ray r(position_ + offset, normalize(lowerLeftCorner_ + s * horizontal_ + t * vertical_ - position_ - offset), time, true, &sampler);
+    r.coneSpread = pixelSpread_;
+    return r;
+}
+
+bool Camera::project(const Vec3& p, double& s, double& t) const
+{
+    Vec3 d = p - position_;
+    double depth = dot(d, w_);
+
+    if (depth <= 0.0)
+    {
+        return false;
+    }
+
+    // Onto the plane the image corners lie on, then into its axes
+    Vec3 corner = lowerLeftCorner_ - position_;
+    Vec3 q = d * (dot(corner, w_) / depth) - corner;
+    s = dot(q, horizontal_) / length2(horizontal_);
+    t = dot(q, vertical_) / length2(vertical_);
+    return true;
 }
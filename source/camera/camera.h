@@ -3,7 +3,9 @@
 #include "core/ray.h"
 #include "core/vec3.h"
 
-struct Rng;
+#include <cstdint>
+
+class Sampler;
 
 class Camera
 {
@@ -20,9 +22,13 @@ public:
         double timeEnd;
     };
 
-    Camera(const CreateInfo& createInfo, double aspectRatio);
+    Camera(const CreateInfo& createInfo, double aspectRatio, uint32_t imageHeight);
+
+    // The ray's cone spreads by the angle a pixel subtends
+    Ray createRay(Sampler& sampler, double s, double t) const;
 
-    Ray createRay(Rng& rng, double s, double t) const;
+    // Image position (s, t) that a point projects to through the centre of the lens, false if it isn't in front
+    bool project(const Vec3& p, double& s, double& t) const;
 
 private:
     Vec3 position_;
@@ -33,6 +39,7 @@ private:
     Vec3 v_;
     Vec3 w_;
     double lensRadius_;
+    double pixelSpread_;
     double timeBegin_;
     double timeEnd_;
 };
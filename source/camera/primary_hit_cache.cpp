@@ -0,0 +1,139 @@
+#include "primary_hit_cache.h"
+
+#include "core/sampler.h"
+#include "scenes/scene.h"
+
+#include <algorithm>
+#include <atomic>
+#include <limits>
+#include <memory>
+#include <thread>
+
+// Largest G-buffer that will be allocated, fewer positions per pixel are kept for images that would need more
+constexpr size_t MaxCacheBytes = size_t(1) << 30;
+
+// Rows a job builds at a time, the rasterizer draws every primitive once per band so bands shouldn't be too thin
+constexpr uint32_t BandRows = 16;
+
+PrimaryHitCache::PrimaryHitCache(const CreateInfo& createInfo)
+    : info_(createInfo)
+{
+    size_t fit = MaxCacheBytes / (std::max(size_t(info_.width) * info_.height, size_t(1)) * sizeof(Entry));
+    info_.samplesPerPixel = std::max(info_.samplesPerPixel, 1u);
+    info_.subsamples = uint32_t(std::min({ size_t(std::max(info_.subsamples, 1u)), size_t(info_.samplesPerPixel), fit }));
+    entries_.resize(size_t(info_.width) * info_.height * info_.subsamples);
+}
+
+bool PrimaryHitCache::supported(const Camera::CreateInfo& cameraCreateInfo)
+{
+    return cameraCreateInfo.aperature == 0.0 && cameraCreateInfo.timeBegin == cameraCreateInfo.timeEnd;
+}
+
+void PrimaryHitCache::build(const Scene& scene, uint32_t numJobs)
+{
+    std::unique_ptr<Rasterizer> rasterizer;
+
+    if (info_.rasterize)
+    {
+        rasterizer = std::make_unique<Rasterizer>(Rasterizer::CreateInfo{ info_.width, info_.height });
+        rasterizer->setup(scene);
+    }
+
+    std::atomic<uint32_t> nextBand{ 0 };
+    std::vector<std::thread> threads;
+
+    for (uint32_t i = 0; i < std::max(numJobs, 1u); ++i)
+    {
+        threads.emplace_back([this, &scene, &rasterizer, &nextBand]()
+        {
+            std::unique_ptr<Sampler> sampler = createSampler(info_.sampler, info_.seed);
+            std::vector<Rasterizer::Fragment> fragments;
+
+            for (uint32_t y0 = BandRows * nextBand++; y0 < info_.height && sampler; y0 = BandRows * nextBand++)
+            {
+                uint32_t y1 = std::min(y0 + BandRows, info_.height);
+
+                if (rasterizer)
+                {
+                    fragments.resize(size_t(y1 - y0) * info_.width * info_.subsamples);
+                    rasterizeRows(scene, *rasterizer, *sampler, fragments.data(), y0, y1);
+                }
+                else
+                {
+                    traceRows(scene, *sampler, y0, y1);
+                }
+            }
+        });
+    }
+
+    for (std::thread& thread : threads)
+    {
+        thread.join();
+    }
+}
+
+Ray PrimaryHitCache::cameraRay(const Scene& scene, Sampler& sampler, uint32_t x, uint32_t y, uint32_t i)
+{
+    // The render's first pixel samples give the positions, so with a position per sample the image is unchanged
+    Entry& entry = entries_[(size_t(y) * info_.width + x) * info_.subsamples + i];
+    sampler.startPixelSample(x, y, i);
+    entry.u = sampler();
+    entry.v = sampler();
+    entry.hit = HitRecord{};
+    return scene.camera->createRay(sampler, (x + entry.u) / info_.width, (y + entry.v) / info_.height);
+}
+
+void PrimaryHitCache::traceRows(const Scene& scene, Sampler& sampler, uint32_t y0, uint32_t y1)
+{
+    for (uint32_t y = y0; y < y1; ++y)
+    {
+        for (uint32_t x = 0; x < info_.width; ++x)
+        {
+            for (uint32_t i = 0; i < info_.subsamples; ++i)
+            {
+                Entry& entry = entries_[(size_t(y) * info_.width + x) * info_.subsamples + i];
+                Ray r = cameraRay(scene, sampler, x, y, i);
+                DrawDetector detector;
+                r.sampler = &detector;
+                entry.found = scene.hit(r, 0.001, std::numeric_limits<double>::infinity(), entry.hit);
+                entry.reusable = !detector.drawn;
+            }
+        }
+    }
+}
+
+void PrimaryHitCache::rasterizeRows(const Scene& scene, const Rasterizer& rasterizer, Sampler& sampler, Rasterizer::Fragment* fragments,
+    uint32_t y0, uint32_t y1)
+{
+    Rasterizer::Fragment* fragment = fragments;
+
+    for (uint32_t y = y0; y < y1; ++y)
+    {
+        for (uint32_t x = 0; x < info_.width; ++x)
+        {
+            for (uint32_t i = 0; i < info_.subsamples; ++i, ++fragment)
+            {
+                fragment->ray = cameraRay(scene, sampler, x, y, i);
+                const Entry& entry = entries_[(size_t(y) * info_.width + x) * info_.subsamples + i];
+                fragment->x = x + entry.u;
+                fragment->y = y + entry.v;
+            }
+        }
+    }
+
+    rasterizer.draw(fragments, info_.subsamples, y0, y1);
+    fragment = fragments;
+
+    for (uint32_t y = y0; y < y1; ++y)
+    {
+        for (uint32_t x = 0; x < info_.width; ++x)
+        {
+            for (uint32_t i = 0; i < info_.subsamples; ++i, ++fragment)
+            {
+                Entry& entry = entries_[(size_t(y) * info_.width + x) * info_.subsamples + i];
+                entry.reusable = !fragment->random;
+                entry.found = entry.reusable && rasterizer.resolve(*fragment, entry.hit);
+            }
+        }
+    }
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include "camera/camera.h"
+#include "camera/rasterizer.h"
+#include "core/hit_record.h"
+
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+class Sampler;
+class Scene;
+
+// G-buffer of camera ray intersections for the first few jittered positions of every pixel, found once before rendering
+// so that samples can skip tracing their camera ray. Each position is shared by a consecutive run of pixel samples, which
+// limits the antialiasing to that many positions per pixel but keeps the rest of each path drawn from a stratified block
+// of samples. Only valid when a position on the image always gives the same ray, i.e. without depth of field or motion
+// blur.
+class PrimaryHitCache
+{
+public:
+    struct CreateInfo
+    {
+        uint32_t width;
+        uint32_t height;
+        uint32_t subsamples;        // Jittered positions per pixel, fewer are kept if they wouldn't fit in memory
+        uint32_t samplesPerPixel;   // Of the render, shared out between the positions
+        std::string_view sampler;   // Must match the render's, the positions are its first pixel samples
+        uint32_t seed;
+        bool rasterize;             // Find the hits with Rasterizer rather than by tracing through the scene
+    };
+
+    struct Entry
+    {
+        double u;               // Position within the pixel
+        double v;
+        HitRecord hit;
+        bool found;             // The ray hit something, otherwise it escaped
+        bool reusable;          // Finding the hit didn't draw random numbers (e.g. inside a medium), so it's the same for every sample
+    };
+
+    PrimaryHitCache(const CreateInfo& createInfo);
+
+    static bool supported(const Camera::CreateInfo& cameraCreateInfo);
+
+    void build(const Scene& scene, uint32_t numJobs);
+
+    // Positions per pixel that were actually kept, zero when not even one fits
+    uint32_t subsamples() const { return info_.subsamples; }
+
+    // Sample sampleIndex of the render uses position sampleIndex * subsamples / samplesPerPixel. Runs of consecutive
+    // samples are the ones a Sobol or blue noise sampler keeps stratified against each other, a stride through the
+    // samples wouldn't be.
+    const Entry& entry(uint32_t x, uint32_t y, uint32_t sampleIndex) const
+    {
+        uint32_t position = uint32_t(uint64_t(sampleIndex) * info_.subsamples / info_.samplesPerPixel);
+        return entries_[(size_t(y) * info_.width + x) * info_.subsamples + position];
+    }
+
+private:
+    // Fills in an entry's position and returns its camera ray
+    Ray cameraRay(const Scene& scene, Sampler& sampler, uint32_t x, uint32_t y, uint32_t i);
+    void traceRows(const Scene& scene, Sampler& sampler, uint32_t y0, uint32_t y1);
+    void rasterizeRows(const Scene& scene, const Rasterizer& rasterizer, Sampler& sampler, Rasterizer::Fragment* fragments, uint32_t y0,
+        uint32_t y1);
+
+    CreateInfo info_;
+    std::vector<Entry> entries_;
+};
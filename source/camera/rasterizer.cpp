@@ -0,0 +1,170 @@
+#include "rasterizer.h"
+
+#include "camera/camera.h"
+#include "core/aabb.h"
+#include "core/hit_record.h"
+#include "core/sampler.h"
+#include "scenes/scene.h"
+#include "shapes/hittable.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+// Widens the projected bounds a little so rounding can't cull a primitive from a position it covers
+constexpr double BoundsMargin = 1e-3;
+
+Rasterizer::Rasterizer(const CreateInfo& createInfo)
+    : info_(createInfo)
+{
+}
+
+void Rasterizer::setup(const Scene& scene)
+{
+    std::vector<const IHittable*> shapes;
+    scene.primitives(shapes);
+
+    const Camera& camera = *scene.camera;
+    double timeBegin = scene.cameraCreateInfo.timeBegin;
+    double timeEnd = scene.cameraCreateInfo.timeEnd;
+    Vec3 eye = scene.cameraCreateInfo.position;
+    double width = double(info_.width);
+    double height = double(info_.height);
+    primitives_.clear();
+
+    for (const IHittable* shape : shapes)
+    {
+        // Unbounded primitives, and bounds that reach behind the camera, can cover any part of the screen
+        Primitive primitive{ shape, 0.0, 0.0, 0.0, width, height };
+        Aabb box;
+
+        if (shape->boundingBox(timeBegin, timeEnd, box))
+        {
+            primitive.distance = length(glm::max(glm::max(box.mins - eye, eye - box.maxs), Vec3(0, 0, 0)));
+            double minS = std::numeric_limits<double>::infinity();
+            double minT = std::numeric_limits<double>::infinity();
+            double maxS = -std::numeric_limits<double>::infinity();
+            double maxT = -std::numeric_limits<double>::infinity();
+            int numBehind = 0;
+
+            for (int i = 0; i < 8; ++i)
+            {
+                Vec3 corner((i & 1) ? box.maxs.x : box.mins.x, (i & 2) ? box.maxs.y : box.mins.y, (i & 4) ? box.maxs.z : box.mins.z);
+                double s;
+                double t;
+
+                if (!camera.project(corner, s, t))
+                {
+                    ++numBehind;
+                    continue;
+                }
+
+                minS = std::min(minS, s);
+                minT = std::min(minT, t);
+                maxS = std::max(maxS, s);
+                maxT = std::max(maxT, t);
+            }
+
+            // Camera rays can't reach anything entirely behind the camera
+            if (numBehind == 8)
+            {
+                continue;
+            }
+
+            if (numBehind == 0)
+            {
+                primitive.minX = minS * width - BoundsMargin;
+                primitive.minY = minT * height - BoundsMargin;
+                primitive.maxX = maxS * width + BoundsMargin;
+                primitive.maxY = maxT * height + BoundsMargin;
+            }
+        }
+
+        if (primitive.maxX >= 0.0 && primitive.minX <= width && primitive.maxY >= 0.0 && primitive.minY <= height)
+        {
+            primitives_.push_back(primitive);
+        }
+    }
+
+    // Drawn nearest first, so the depth test rejects most of what's hidden before intersecting it
+    std::stable_sort(primitives_.begin(), primitives_.end(), [](const Primitive& a, const Primitive& b)
+    {
+        return a.distance < b.distance;
+    });
+}
+
+void Rasterizer::draw(Fragment* fragments, uint32_t samplesPerPixel, uint32_t y0, uint32_t y1) const
+{
+    size_t numFragments = size_t(y1 - y0) * info_.width * samplesPerPixel;
+
+    for (size_t i = 0; i < numFragments; ++i)
+    {
+        fragments[i].depth = std::numeric_limits<double>::infinity();
+        fragments[i].primitive = NoPrimitive;
+        fragments[i].random = false;
+    }
+
+    double lastX = double(info_.width - 1);
+
+    for (uint32_t index = 0; index < primitives_.size(); ++index)
+    {
+        const Primitive& primitive = primitives_[index];
+
+        if (primitive.maxY < y0 || primitive.minY >= y1)
+        {
+            continue;
+        }
+
+        // Only the pixels the screen bounds overlap are visited
+        uint32_t minX = uint32_t(std::clamp(std::floor(primitive.minX), 0.0, lastX));
+        uint32_t maxX = uint32_t(std::clamp(std::floor(primitive.maxX), 0.0, lastX));
+        uint32_t minY = uint32_t(std::clamp(std::floor(primitive.minY), double(y0), double(y1 - 1)));
+        uint32_t maxY = uint32_t(std::clamp(std::floor(primitive.maxY), double(y0), double(y1 - 1)));
+
+        for (uint32_t y = minY; y <= maxY; ++y)
+        {
+            for (uint32_t x = minX; x <= maxX; ++x)
+            {
+                Fragment* pixel = fragments + (size_t(y - y0) * info_.width + x) * samplesPerPixel;
+
+                for (uint32_t s = 0; s < samplesPerPixel; ++s)
+                {
+                    Fragment& fragment = pixel[s];
+
+                    if (primitive.distance > fragment.depth || fragment.x < primitive.minX || fragment.x > primitive.maxX ||
+                        fragment.y < primitive.minY || fragment.y > primitive.maxY)
+                    {
+                        continue;
+                    }
+
+                    // The depth test, a hit has to be closer than the one kept so far
+                    DrawDetector detector;
+                    Ray r = fragment.ray;
+                    r.sampler = &detector;
+                    HitRecord test{};
+
+                    if (primitive.shape->hit(r, 0.001, fragment.depth, test))
+                    {
+                        fragment.depth = test.t;
+                        fragment.primitive = index;
+                    }
+
+                    fragment.random = fragment.random || detector.drawn;
+                }
+            }
+        }
+    }
+}
+
+bool Rasterizer::resolve(const Fragment& fragment, HitRecord& hit) const
+{
+    if (fragment.primitive == NoPrimitive)
+    {
+        return false;
+    }
+
+    DrawDetector detector;
+    Ray r = fragment.ray;
+    r.sampler = &detector;
+    return primitives_[fragment.primitive].shape->hit(r, 0.001, std::numeric_limits<double>::infinity(), hit);
+}
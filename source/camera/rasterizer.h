@@ -0,0 +1,62 @@
+#pragma once
+
+#include "core/ray.h"
+
+#include <cstdint>
+#include <vector>
+
+class IHittable;
+class Scene;
+struct HitRecord;
+
+// Primary visibility for pinhole cameras by rasterization. The scene is flattened into primitives and their bounds are
+// projected onto the image. draw() then walks the primitives nearest first, and each one only visits the camera
+// samples inside its screen bounds, keeping the closest primitive per sample in a depth and ID buffer. Coverage is
+// decided by the primitives' own intersection code, so spheres are exact imposters. resolve() intersects the winning
+// primitive once more for the full hit, which matches tracing the scene.
+class Rasterizer
+{
+public:
+    struct CreateInfo
+    {
+        uint32_t width;
+        uint32_t height;
+    };
+
+    // A camera sample, x and y are its image position in pixels. draw() fills in the rest.
+    struct Fragment
+    {
+        Ray ray;
+        double x;
+        double y;
+        double depth;           // Distance along ray to the nearest primitive so far
+        uint32_t primitive;     // NoPrimitive when nothing covers the sample
+        bool random;            // Some coverage test drew random numbers (e.g. inside a medium), so it can't be kept
+    };
+
+    static constexpr uint32_t NoPrimitive = ~0u;
+
+    Rasterizer(const CreateInfo& createInfo);
+
+    void setup(const Scene& scene);
+
+    // Draws every primitive into the fragments of rows [y0, y1), which are stored row by row with samplesPerPixel
+    // fragments per pixel
+    void draw(Fragment* fragments, uint32_t samplesPerPixel, uint32_t y0, uint32_t y1) const;
+
+    bool resolve(const Fragment& fragment, HitRecord& hit) const;
+
+private:
+    struct Primitive
+    {
+        const IHittable* shape;
+        double distance;        // From the camera to the nearest point of the bounds
+        double minX;            // Screen space bounds in pixels
+        double minY;
+        double maxX;
+        double maxY;
+    };
+
+    CreateInfo info_;
+    std::vector<Primitive> primitives_;     // Nearest first
+};
@@ -35,6 +35,31 @@ bool Aabb::hit(const Ray& r, double tMin, double tMax) const
     return true;
 }
 
+bool Aabb::clip(const Ray& r, double& tMin, double& tMax) const
+{
+    for (int a = 0; a < 3; a++)
+    {
+        double invD = 1.0 / r.direction[a];
+        double t0 = (mins[a] - r.origin[a]) * invD;
+        double t1 = (maxs[a] - r.origin[a]) * invD;
+
+        if (invD < 0.0)
+        {
+            std::swap(t0, t1);
+        }
+
+        tMin = t0 > tMin ? t0 : tMin;
+        tMax = t1 < tMax ? t1 : tMax;
+
+        if (tMax <= tMin)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
 Aabb Aabb::makeUnion(const Aabb& other) const
 {
     Aabb result{};
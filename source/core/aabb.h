@@ -11,6 +11,9 @@ struct Aabb
 
     bool hit(const Ray& r, double tMin, double tMax) const;
 
+    // Same test as hit(), narrowing [tMin, tMax] to the part of the ray inside the box
+    bool clip(const Ray& r, double& tMin, double& tMax) const;
+
     Aabb makeUnion(const Aabb& other) const;
     Vec3 extents() const;
     Vec3 corner(int index) const;
@@ -20,6 +20,26 @@ bool parseCommandLine(int argc, char** argv, CommandLineArguments& arguments)
             ("h,height", "Image height", cxxopts::value<uint32_t>()->default_value(print(arguments.imageHeight).c_str()))
             ("s,samples", "Samples per pixel", cxxopts::value<uint32_t>()->default_value(print(arguments.samplesPerPixel).c_str()))
             ("d,maxdepth", "Maximum ray bounces", cxxopts::value<uint32_t>()->default_value(print(arguments.maxDepth).c_str()))
+            ("maxdiffuse", "Maximum diffuse bounces", cxxopts::value<uint32_t>()->default_value(print(arguments.maxDiffuseDepth).c_str()))
+            ("maxspecular", "Maximum specular bounces", cxxopts::value<uint32_t>()->default_value(print(arguments.maxSpecularDepth).c_str()))
+            ("maxvolume", "Maximum volume scattering bounces", cxxopts::value<uint32_t>()->default_value(print(arguments.maxVolumeDepth).c_str()))
+            ("rrdepth", "Bounces before Russian roulette path termination", cxxopts::value<uint32_t>()->default_value(print(arguments.rouletteDepth).c_str()))
+            ("lightsampling", "Sample emitters and the sky explicitly", cxxopts::value<bool>()->default_value(arguments.lightSampling ? "true" : "false"))
+            ("sampler", "Sample generator (random, sobol, bluenoise)", cxxopts::value<std::string>()->default_value(arguments.sampler))
+            ("guiding", "Learn incident radiance with an SD-tree and use it to guide bounces", cxxopts::value<bool>()->default_value(arguments.guiding ? "true" : "false"))
+            ("guidingtraining", "Fraction of the samples spent training the guide", cxxopts::value<double>()->default_value(std::to_string(arguments.guidingTraining)))
+            ("cache", "Radiance cache quality, 0 disables it and higher values are slower but blur less", cxxopts::value<uint32_t>()->default_value(print(arguments.cacheQuality).c_str()))
+            ("photons", "Caustic photons traced per pass, 0 disables the photon map", cxxopts::value<uint32_t>()->default_value(print(arguments.photons).c_str()))
+            ("photonradius", "Initial caustic gather radius as a fraction of the scene size", cxxopts::value<double>()->default_value(std::to_string(arguments.photonRadius)))
+            ("split", "Most paths continued from each camera ray's first hit, fewer on glossy surfaces and one on mirrors and glass", cxxopts::value<uint32_t>()->default_value(print(arguments.primarySplits).c_str()))
+            ("primarycache", "Camera ray positions per pixel whose hits are cached and shared by runs of samples, 0 disables the cache", cxxopts::value<uint32_t>()->default_value(print(arguments.primaryCache).c_str()))
+            ("raster", "Fill the primary hit cache by rasterizing the scene instead of tracing camera rays", cxxopts::value<bool>()->default_value(arguments.rasterize ? "true" : "false"))
+            ("wavefront", "Trace tiles of paths a stage at a time, each material shading its hits in one batch", cxxopts::value<bool>()->default_value(arguments.wavefront ? "true" : "false"))
+            ("packet", "Camera rays of this many neighbouring pixels traced together (up to 16), 0 traces them one at a time", cxxopts::value<uint32_t>()->default_value(print(arguments.packetSize).c_str()))
+            ("sortrays", "Trace the wavefront's bounced and shadow rays sorted by direction octant and origin (needs --wavefront)", cxxopts::value<bool>()->default_value(arguments.sortRays ? "true" : "false"))
+            ("texturecache", "Megabytes of texture pages kept in memory, shared by every image texture, 0 loads images into memory whole", cxxopts::value<uint32_t>()->default_value(print(arguments.textureCache).c_str()))
+            ("texturedir", "Directory for the tiled copies of images the texture cache pages in", cxxopts::value<std::string>()->default_value(arguments.textureDirectory))
+            ("seed", "Sample pattern seed, e.g. the frame number", cxxopts::value<uint32_t>()->default_value(print(arguments.seed).c_str()))
             ("j,numjobs", "Number of parallel jobs", cxxopts::value<uint32_t>()->default_value(print(arguments.numJobs).c_str()))
             ("o,output", "Output filename (without extension)", cxxopts::value<std::string>()->default_value(arguments.outputName))
             ("sky", "HDRI sky", cxxopts::value<std::string>()->default_value(arguments.hdriSkyPath))
@@ -39,6 +59,26 @@ bool parseCommandLine(int argc, char** argv, CommandLineArguments& arguments)
         arguments.imageHeight = commandLine["height"].as<uint32_t>();
         arguments.samplesPerPixel = commandLine["samples"].as<uint32_t>();
         arguments.maxDepth = commandLine["maxdepth"].as<uint32_t>();
+        arguments.maxDiffuseDepth = commandLine["maxdiffuse"].as<uint32_t>();
+        arguments.maxSpecularDepth = commandLine["maxspecular"].as<uint32_t>();
+        arguments.maxVolumeDepth = commandLine["maxvolume"].as<uint32_t>();
+        arguments.rouletteDepth = commandLine["rrdepth"].as<uint32_t>();
+        arguments.lightSampling = commandLine["lightsampling"].as<bool>();
+        arguments.sampler = commandLine["sampler"].as<std::string>();
+        arguments.seed = commandLine["seed"].as<uint32_t>();
+        arguments.guiding = commandLine["guiding"].as<bool>();
+        arguments.guidingTraining = commandLine["guidingtraining"].as<double>();
+        arguments.cacheQuality = commandLine["cache"].as<uint32_t>();
+        arguments.photons = commandLine["photons"].as<uint32_t>();
+        arguments.photonRadius = commandLine["photonradius"].as<double>();
+        arguments.primarySplits = commandLine["split"].as<uint32_t>();
+        arguments.primaryCache = commandLine["primarycache"].as<uint32_t>();
+        arguments.rasterize = commandLine["raster"].as<bool>();
+        arguments.wavefront = commandLine["wavefront"].as<bool>();
+        arguments.packetSize = commandLine["packet"].as<uint32_t>();
+        arguments.sortRays = commandLine["sortrays"].as<bool>();
+        arguments.textureCache = commandLine["texturecache"].as<uint32_t>();
+        arguments.textureDirectory = commandLine["texturedir"].as<std::string>();
         arguments.numJobs = commandLine["numjobs"].as<uint32_t>();
         arguments.outputName = commandLine["output"].as<std::string>();
         arguments.hdriSkyPath = commandLine["sky"].as<std::string>();
@@ -9,6 +9,26 @@ struct CommandLineArguments
     uint32_t imageHeight;
     uint32_t samplesPerPixel;
     uint32_t maxDepth;
+    uint32_t maxDiffuseDepth;
+    uint32_t maxSpecularDepth;
+    uint32_t maxVolumeDepth;
+    uint32_t rouletteDepth;
+    bool lightSampling;
+    std::string sampler;
+    uint32_t seed;
+    bool guiding;
+    double guidingTraining;
+    uint32_t cacheQuality;
+    uint32_t photons;
+    double photonRadius;
+    uint32_t primarySplits;
+    uint32_t primaryCache;
+    bool rasterize;
+    bool wavefront;
+    uint32_t packetSize;
+    bool sortRays;
+    uint32_t textureCache;
+    std::string textureDirectory;
     uint32_t numJobs;
     std::string outputName;
     std::string hdriSkyPath;
@@ -0,0 +1,87 @@
+#include "distribution.h"
+
+#include <algorithm>
+
+Distribution1D::Distribution1D(const double* values, size_t count)
+    : func_(values, values + count)
+    , cdf_(count + 1)
+{
+    cdf_[0] = 0.0;
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        cdf_[i + 1] = cdf_[i] + func_[i] / double(count);
+    }
+
+    integral_ = cdf_[count];
+
+    if (integral_ <= 0.0)
+    {
+        // Nothing to importance sample, fall back to uniform
+        for (size_t i = 1; i <= count; ++i)
+        {
+            cdf_[i] = double(i) / double(count);
+        }
+    }
+    else
+    {
+        for (size_t i = 1; i <= count; ++i)
+        {
+            cdf_[i] /= integral_;
+        }
+    }
+}
+
+double Distribution1D::sampleContinuous(double u, double& pdf, size_t& index) const
+{
+    // Last cdf entry <= u
+    auto it = std::upper_bound(cdf_.begin(), cdf_.end(), u);
+    index = std::min(size_t(std::max<ptrdiff_t>(it - cdf_.begin() - 1, 0)), func_.size() - 1);
+
+    double du = u - cdf_[index];
+    double width = cdf_[index + 1] - cdf_[index];
+
+    if (width > 0)
+    {
+        du /= width;
+    }
+
+    pdf = this->pdf(index);
+    return std::min((double(index) + du) / double(func_.size()), 1.0 - 1e-12);
+}
+
+double Distribution1D::pdf(size_t index) const
+{
+    return (integral_ > 0.0) ? func_[index] / integral_ : 1.0;
+}
+
+Distribution2D::Distribution2D(const double* values, size_t width, size_t height)
+{
+    conditional_.reserve(height);
+    std::vector<double> rowIntegrals(height);
+
+    for (size_t y = 0; y < height; ++y)
+    {
+        conditional_.emplace_back(values + y * width, width);
+        rowIntegrals[y] = conditional_.back().integral();
+    }
+
+    marginal_ = Distribution1D(rowIntegrals.data(), height);
+}
+
+void Distribution2D::sampleContinuous(double u0, double u1, double& x, double& y, double& pdf) const
+{
+    double pdfs[2];
+    size_t row;
+    size_t column;
+    y = marginal_.sampleContinuous(u1, pdfs[1], row);
+    x = conditional_[row].sampleContinuous(u0, pdfs[0], column);
+    pdf = pdfs[0] * pdfs[1];
+}
+
+double Distribution2D::pdf(double x, double y) const
+{
+    size_t row = std::min(size_t(y * marginal_.count()), marginal_.count() - 1);
+    size_t column = std::min(size_t(x * conditional_[row].count()), conditional_[row].count() - 1);
+    return conditional_[row].pdf(column) * marginal_.pdf(row);
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+// Piecewise constant distribution over [0, 1), built from non-negative function values
+class Distribution1D
+{
+public:
+    Distribution1D() = default;
+    Distribution1D(const double* values, size_t count);
+
+    size_t count() const { return func_.size(); }
+    double integral() const { return integral_; }
+
+    // Returns a continuous sample in [0, 1), the pdf with respect to that domain and the index of the chosen segment
+    double sampleContinuous(double u, double& pdf, size_t& index) const;
+    double pdf(size_t index) const;
+
+private:
+    std::vector<double> func_;
+    std::vector<double> cdf_;
+    double integral_{ 0.0 };
+};
+
+// Piecewise constant distribution over [0, 1)^2: a marginal distribution over rows and a conditional one per row
+class Distribution2D
+{
+public:
+    Distribution2D() = default;
+    Distribution2D(const double* values, size_t width, size_t height);
+
+    void sampleContinuous(double u0, double u1, double& x, double& y, double& pdf) const;
+    double pdf(double x, double y) const;
+
+private:
+    std::vector<Distribution1D> conditional_;
+    Distribution1D marginal_;
+};
@@ -12,8 +12,15 @@ struct HitRecord
     double t;
     double u;
     double v;
+    Vec3 dpdu;          // Derivatives of p along the texture coordinates, zero for hits without any
+    Vec3 dpdv;
+    double footprint;   // Width of the ray cone at p, zero when unknown
     bool frontFace;
     IMaterial* material;
+    // The material's albedo at p, once hasAlbedo is set. Set by the material the first time it's asked for the albedo,
+    // or by integrators that look albedos up ahead of shading, so a hit samples its texture once.
+    mutable Vec3 albedo;
+    mutable bool hasAlbedo{ false };
 
     void setFaceNormal(const Ray& r, const Vec3& surfaceNormal)
     {
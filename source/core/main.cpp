@@ -1,63 +1,56 @@
 #include <iostream>
+#include <algorithm>
+#include <atomic>
 #include <cassert>
 #include <chrono>
 #include <cstdint>
+#include <limits>
+#include <memory>
 #include <thread>
 
 #include "camera/camera.h"
+#include "camera/primary_hit_cache.h"
 #include "core/command_line.h"
 #include "core/image.h"
 #include "core/ray.h"
-#include "core/rng.h"
+#include "core/ray_packet.h"
+#include "core/sampler.h"
 #include "core/sky.h"
 #include "core/vec3.h"
 #include "core/rtiow.h"
+#include "integrators/path_guiding.h"
+#include "integrators/path_integrator.h"
+#include "integrators/photon_map.h"
+#include "integrators/radiance_cache.h"
+#include "integrators/wavefront_integrator.h"
 #include "materials/material.h"
+#include "materials/texture_cache.h"
 #include "scenes/test_scenes.h"
 #include "shapes/hittable_list.h"
 #include "shapes/sphere.h"
 #include "shapes/sphere_tree.h"
 
-Vec3 rayColor(const Ray& r, const Scene& scene, Rng& rng, int depth)
-{
-    if (depth == 0)
-    {
-        return Vec3{};
-    }
+// Each step of radiance cache quality adds this many cells across the scene and full passes to fill them
+constexpr uint32_t CacheResolution = 16;
+constexpr uint32_t CachePassesPerQuality = 2;
 
-    HitRecord hit{};
-    bool b = scene.hit(r, 0.001, std::numeric_limits<double>::infinity(), hit);
-
-    if (b)
-    {
-        Vec3 attenuation;
-        Ray scattered;
-
-        if (hit.material->scatter(rng, r, hit, attenuation, scattered))
-        {
-            return hit.material->emitted(hit) + attenuation * rayColor(scattered, scene, rng, depth - 1);
-        }
-        else
-        {
-            return hit.material->emitted(hit);
-        }
-    }
-    else
-    {
-        return scene.sky->Sample(r.direction);
-    }
-}
+// Photons emitted for one block of passes, which bounds the memory the photon map takes when every pass has its own
+constexpr uint32_t MaxPhotonsPerBuild = 1u << 22;
 
 struct Job
 {
-    Job(uint32_t width, uint32_t height)
-        : image(width, height)
+    // Packets of camera rays need a sampler for each of their paths, the first one is also used without packets
+    Job(Image& image, std::atomic<int>& nextRow, std::vector<std::unique_ptr<Sampler>> samplers)
+        : image_(&image)
+        , nextRow_(&nextRow)
+        , samplers_(std::move(samplers))
     {
     }
 
-    void run(const Scene& scene, int numPasses, int maxDepth)
+    void run(const Scene& scene, const PathIntegrator& integrator, const WavefrontIntegrator* wavefront, const PrimaryHitCache* primaryHits,
+             int firstPass, int numPasses)
     {
-        thread_ = std::thread(&Job::threadFunc, this, scene, numPasses, maxDepth);
+        thread_ = std::thread(&Job::threadFunc, this, scene, integrator, wavefront, primaryHits, firstPass, numPasses);
     }
 
     void wait()
@@ -65,9 +58,75 @@ struct Job
         thread_.join();
     }
 
-    void threadFunc(const Scene& scene, int numPasses, int maxDepth)
+    // Jobs pull whole rows, or bands of them, and every pixel accumulates all of its samples in order, so the result is
+    // bit identical regardless of the number of jobs
+    void threadFunc(const Scene& scene, const PathIntegrator& integrator, const WavefrontIntegrator* wavefront, const PrimaryHitCache* primaryHits,
+                    int firstPass, int numPasses)
     {
-        for (int y = int(image.height()); --y >= 0;)
+        Image& image = *image_;
+        Sampler& sampler = *samplers_[0];
+        uint32_t packetSize = uint32_t(samplers_.size());
+        std::vector<Vec3> colors(image.width());
+
+        if (packetSize > 1 && !primaryHits && !wavefront)
+        {
+            // Packets cover nearly square tiles, so rows are pulled in bands of the tile height
+            int tileHeight = 1;
+
+            while (uint32_t(tileHeight * tileHeight * 4) <= packetSize)
+            {
+                tileHeight *= 2;
+            }
+
+            int tileWidth = int(packetSize) / tileHeight;
+
+            for (int y1 = (*nextRow_ -= tileHeight) + tileHeight; y1 > 0; y1 = (*nextRow_ -= tileHeight) + tileHeight)
+            {
+                int y0 = std::max(y1 - tileHeight, 0);
+
+                for (int x = 0; x < int(image.width()); x += tileWidth)
+                {
+                    tracePackets(scene, integrator, x, y0, std::min(tileWidth, int(image.width()) - x), y1 - y0, firstPass, numPasses);
+                }
+            }
+
+            return;
+        }
+
+        if (wavefront)
+        {
+            // The wavefront integrator keeps its buffers between runs, and renders tiles so each wave's paths stay close
+            // together on screen
+            if (!workspace_)
+            {
+                workspace_ = wavefront->createWorkspace(sampler);
+            }
+
+            const int tileSize = int(WavefrontIntegrator::TileSize);
+            colors.resize(size_t(tileSize) * tileSize);
+
+            for (int y1 = (*nextRow_ -= tileSize) + tileSize; y1 > 0; y1 = (*nextRow_ -= tileSize) + tileSize)
+            {
+                int y0 = std::max(y1 - tileSize, 0);
+
+                for (int x0 = 0; x0 < int(image.width()); x0 += tileSize)
+                {
+                    int tileWidth = std::min(tileSize, int(image.width()) - x0);
+                    std::fill(colors.begin(), colors.end(), Vec3(0, 0, 0));
+                    wavefront->renderTile(scene, *workspace_, x0, y0, tileWidth, y1 - y0, image.width(), image.height(), firstPass,
+                                          numPasses, colors.data());
+
+                    for (int i = 0; i < tileWidth * (y1 - y0); ++i)
+                    {
+                        image(x0 + i % tileWidth, y0 + i / tileWidth) += colors[i];
+                    }
+                }
+            }
+
+            return;
+        }
+
+        for (int y = --*nextRow_; y >= 0; y = --*nextRow_)
         {
             for (int x = 0; x < int(image.width()); ++x)
             {
@@ -75,19 +134,79 @@ struct Job
 
                 for (int s = 0; s < numPasses; ++s)
                 {
-                    double u = double(x + rng_()) / image.width();
-                    double v = double(y + rng_()) / image.height();
-                    Ray r = scene.camera->createRay(rng_, u, v);
-                    color += rayColor(r, scene, rng_, maxDepth);
+                    sampler.startPixelSample(x, y, firstPass + s);
+
+                    if (primaryHits)
+                    {
+                        const PrimaryHitCache::Entry& primary = primaryHits->entry(x, y, firstPass + s);
+                        double u = double(x + primary.u) / image.width();
+                        double v = double(y + primary.v) / image.height();
+                        Ray r = scene.camera->createRay(sampler, u, v);
+                        color += primary.reusable ? integrator.radiance(r, primary.found ? &primary.hit : nullptr, scene, sampler)
+                                                  : integrator.radiance(r, scene, sampler);
+                        continue;
+                    }
+
+                    double u = double(x + sampler()) / image.width();
+                    double v = double(y + sampler()) / image.height();
+                    Ray r = scene.camera->createRay(sampler, u, v);
+                    color += integrator.radiance(r, scene, sampler);
                 }
 
-                image(x, y) = color;
+                image(x, y) += color;
+            }
+        }
+    }
+
+    // The camera rays of a tile of pixels are traced as one packet per pass, then each pixel sample continues its path
+    // from the hit found for it. Every path has its own sampler, so anything drawn while finding its hit (e.g. in a
+    // medium) comes from the numbers it would have used on its own.
+    void tracePackets(const Scene& scene, const PathIntegrator& integrator, int x0, int y0, int width, int height, int firstPass, int numPasses)
+    {
+        Image& image = *image_;
+        uint32_t count = uint32_t(width * height);
+        Vec3 colors[MaxPacketSize] = {};
+        RayPacket packet;
+        HitRecord hits[MaxPacketSize];
+        double tMax[MaxPacketSize];
+
+        packet.size = count;
+        std::fill(tMax, tMax + count, std::numeric_limits<double>::infinity());
+
+        for (int s = 0; s < numPasses; ++s)
+        {
+            for (uint32_t i = 0; i < count; ++i)
+            {
+                int x = x0 + int(i) % width;
+                int y = y0 + int(i) / width;
+                Sampler& sampler = *samplers_[i];
+                sampler.startPixelSample(x, y, firstPass + s);
+                double u = double(x + sampler()) / image.width();
+                double v = double(y + sampler()) / image.height();
+                packet.rays[i] = scene.camera->createRay(sampler, u, v);
+                sampler.startDimension(0, Sampler::Dimension::Medium);
+                hits[i] = HitRecord{};
+            }
+
+            packet.computeBounds();
+            uint32_t found = scene.hitPacket(packet, (1u << count) - 1, 0.001, tMax, hits);
+
+            for (uint32_t i = 0; i < count; ++i)
+            {
+                colors[i] += integrator.radiance(packet.rays[i], (found & (1u << i)) ? &hits[i] : nullptr, scene, *samplers_[i]);
             }
         }
+
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            image(x0 + int(i) % width, y0 + int(i) / width) += colors[i];
+        }
     }
 
-    Image image;
-    Rng rng_;
+    Image* image_;
+    std::atomic<int>* nextRow_;
+    std::vector<std::unique_ptr<Sampler>> samplers_;
+    std::shared_ptr<WavefrontIntegrator::Workspace> workspace_;
     std::thread thread_;
 };
 
@@ -98,6 +217,26 @@ int main(int argc, char** argv)
     args.imageHeight = 512;
     args.samplesPerPixel = 100;
     args.maxDepth = 50;
+    args.maxDiffuseDepth = 50;
+    args.maxSpecularDepth = 50;
+    args.maxVolumeDepth = 50;
+    args.rouletteDepth = 3;
+    args.lightSampling = true;
+    args.sampler = "sobol";
+    args.seed = 0;
+    args.guiding = false;
+    args.guidingTraining = 0.25;
+    args.cacheQuality = 0;
+    args.photons = 0;
+    args.photonRadius = 0.005;
+    args.primarySplits = 1;
+    args.primaryCache = 0;
+    args.rasterize = false;
+    args.wavefront = false;
+    args.packetSize = 0;
+    args.sortRays = false;
+    args.textureCache = 0;
+    args.textureDirectory = TextureCache::get().directory();
     args.numJobs = std::thread::hardware_concurrency();
     args.outputName = "image";
     args.sceneId = UINT32_MAX;
@@ -108,6 +247,8 @@ int main(int argc, char** argv)
     }
 
     double aspectRatio = double(args.imageWidth) / double(args.imageHeight);
+    TextureCache::get().setBudget(size_t(args.textureCache) << 20);
+    TextureCache::get().setDirectory(args.textureDirectory);
 
     Image image{ args.imageWidth, args.imageHeight };
     Scene scene{};
@@ -154,6 +295,26 @@ int main(int argc, char** argv)
             scene = scenes::smokeBoxes();
             break;
         }
+        case 9:
+        {
+            scene = scenes::indirectCornellBox();
+            break;
+        }
+        case 10:
+        {
+            scene = scenes::manyLights();
+            break;
+        }
+        case 11:
+        {
+            scene = scenes::noisySmoke();
+            break;
+        }
+        case 12:
+        {
+            scene = scenes::voxelCloud();
+            break;
+        }
         default:
         case 8:
         {
@@ -162,39 +323,215 @@ int main(int argc, char** argv)
         }
     }
 
-    scene.camera = std::make_shared<Camera>(scene.cameraCreateInfo, aspectRatio);
+    scene.camera = std::make_shared<Camera>(scene.cameraCreateInfo, aspectRatio, args.imageHeight);
+    scene.lights.build(scene, scene.cameraCreateInfo.timeBegin, scene.cameraCreateInfo.timeEnd);
+
+    PathIntegrator::CreateInfo integratorCreateInfo{};
+    integratorCreateInfo.maxDepth = args.maxDepth;
+    integratorCreateInfo.maxDiffuseDepth = args.maxDiffuseDepth;
+    integratorCreateInfo.maxSpecularDepth = args.maxSpecularDepth;
+    integratorCreateInfo.maxVolumeDepth = args.maxVolumeDepth;
+    integratorCreateInfo.rouletteDepth = args.rouletteDepth;
+    integratorCreateInfo.lightSampling = args.lightSampling;
+    integratorCreateInfo.primarySplits = args.primarySplits;
+    PathIntegrator integrator{ integratorCreateInfo };
+
+    if (args.sortRays && !args.wavefront)
+    {
+        std::cerr << "Sorting rays needs the wavefront integrator, add --wavefront.\n";
+        exit(EXIT_FAILURE);
+    }
+
+    // Renders tiles a stage at a time instead of a path at a time, only for plain path tracing
+    std::unique_ptr<WavefrontIntegrator> wavefront;
+
+    if (args.wavefront)
+    {
+        if (args.guiding || args.cacheQuality > 0 || args.photons > 0 || args.primarySplits > 1 || args.primaryCache > 0)
+        {
+            std::cerr << "The wavefront integrator can't be combined with guiding, the radiance cache, photons, splitting or the primary hit cache.\n";
+            exit(EXIT_FAILURE);
+        }
+
+        WavefrontIntegrator::CreateInfo wavefrontCreateInfo{};
+        wavefrontCreateInfo.maxDepth = args.maxDepth;
+        wavefrontCreateInfo.maxDiffuseDepth = args.maxDiffuseDepth;
+        wavefrontCreateInfo.maxSpecularDepth = args.maxSpecularDepth;
+        wavefrontCreateInfo.maxVolumeDepth = args.maxVolumeDepth;
+        wavefrontCreateInfo.rouletteDepth = args.rouletteDepth;
+        wavefrontCreateInfo.lightSampling = args.lightSampling;
+        wavefrontCreateInfo.sortRays = args.sortRays;
+        wavefront = std::make_unique<WavefrontIntegrator>(wavefrontCreateInfo);
+    }
 
     if (args.numJobs == 0)
     {
         args.numJobs = 1;
     }
 
-    uint32_t passesPerJob = args.samplesPerPixel / args.numJobs;
-    uint32_t extraPasses = args.samplesPerPixel % args.numJobs;
+    std::atomic<int> nextRow{ int(args.imageHeight) };
     std::vector<Job> jobs;
 
+    uint32_t samplersPerJob = std::clamp(args.packetSize, 1u, MaxPacketSize);
+
     for (uint32_t i = 0; i < args.numJobs; ++i)
     {
-        jobs.push_back(Job(args.imageWidth, args.imageHeight));
+        std::vector<std::unique_ptr<Sampler>> samplers;
+
+        for (uint32_t j = 0; j < samplersPerJob; ++j)
+        {
+            std::unique_ptr<Sampler> sampler = createSampler(args.sampler, args.seed);
+
+            if (!sampler)
+            {
+                std::cerr << "Unknown sampler '" << args.sampler << "'\n";
+                exit(EXIT_FAILURE);
+            }
+
+            samplers.push_back(std::move(sampler));
+        }
+
+        jobs.push_back(Job(image, nextRow, std::move(samplers)));
     }
 
     std::cerr << "Running " << args.numJobs << " jobs...\n";
     auto startTime = std::chrono::system_clock::now();
 
-    for (uint32_t i = 0; i < extraPasses; ++i)
+    // With guiding, the first part of the budget is rendered in iterations of doubling length, refining the guide after
+    // each one. Their samples are kept in the image.
+    std::shared_ptr<SdTree> guide;
+    uint32_t trainingPasses = 0;
+
+    // The radiance cache is filled by the first passes, which are traced in full and also kept in the image
+    std::shared_ptr<RadianceCache> cache;
+    uint32_t cachePasses = 0;
+
+    // Every pass gets its own caustic photons, with a smaller gather radius each time. They're traced for a block of
+    // passes at a time.
+    std::shared_ptr<PhotonMap> photonMap;
+
+    Aabb bounds;
+
+    if ((args.guiding || args.cacheQuality > 0 || args.photons > 0) &&
+        scene.boundingBox(scene.cameraCreateInfo.timeBegin, scene.cameraCreateInfo.timeEnd, bounds))
     {
-        jobs[i].run(scene, passesPerJob + 1, args.maxDepth);
+        if (args.guiding)
+        {
+            guide = std::make_shared<SdTree>(bounds);
+            trainingPasses = uint32_t(args.samplesPerPixel * std::clamp(args.guidingTraining, 0.0, 1.0));
+        }
+
+        if (args.cacheQuality > 0)
+        {
+            cache = std::make_shared<RadianceCache>(bounds, CacheResolution * args.cacheQuality);
+            cachePasses = std::min(args.cacheQuality * CachePassesPerQuality, args.samplesPerPixel);
+        }
+
+        if (args.photons > 0 && !scene.lights.empty())
+        {
+            Vec3 extents = bounds.extents();
+
+            PhotonMap::CreateInfo photonMapCreateInfo{};
+            photonMapCreateInfo.numPhotons = args.photons;
+            photonMapCreateInfo.radius = args.photonRadius * std::max(extents.x, std::max(extents.y, extents.z));
+            photonMapCreateInfo.maxDepth = args.maxSpecularDepth;
+            photonMapCreateInfo.seed = args.seed;
+            photonMap = std::make_shared<PhotonMap>(photonMapCreateInfo);
+        }
     }
 
-    for (uint32_t i = extraPasses; i < args.numJobs; ++i)
+    // Camera ray hits for a few positions per pixel, reused by every sample
+    std::unique_ptr<PrimaryHitCache> primaryHits;
+
+    if (args.rasterize && args.primaryCache == 0)
     {
-        jobs[i].run(scene, passesPerJob, args.maxDepth);
+        std::cerr << "Rasterizing only applies to the primary hit cache.\n";
     }
 
-    for (Job& j : jobs)
+    if (args.packetSize > 1 && (args.primaryCache > 0 || args.wavefront))
     {
-        j.wait();
-        image += j.image;
+        std::cerr << "Ray packets aren't used with the primary hit cache or the wavefront integrator.\n";
+    }
+
+    if (args.primaryCache > 0)
+    {
+        if (PrimaryHitCache::supported(scene.cameraCreateInfo))
+        {
+            PrimaryHitCache::CreateInfo primaryHitCacheCreateInfo{};
+            primaryHitCacheCreateInfo.width = args.imageWidth;
+            primaryHitCacheCreateInfo.height = args.imageHeight;
+            primaryHitCacheCreateInfo.subsamples = args.primaryCache;
+            primaryHitCacheCreateInfo.samplesPerPixel = args.samplesPerPixel;
+            primaryHitCacheCreateInfo.sampler = args.sampler;
+            primaryHitCacheCreateInfo.seed = args.seed;
+            primaryHitCacheCreateInfo.rasterize = args.rasterize;
+            primaryHits = std::make_unique<PrimaryHitCache>(primaryHitCacheCreateInfo);
+
+            if (primaryHits->subsamples() == 0)
+            {
+                std::cerr << "Primary hit cache disabled, the image is too large.\n";
+                primaryHits.reset();
+            }
+            else
+            {
+                if (primaryHits->subsamples() < std::min(args.primaryCache, args.samplesPerPixel))
+                {
+                    std::cerr << "Primary hit cache limited to " << primaryHits->subsamples() << " positions per pixel.\n";
+                }
+
+                primaryHits->build(scene, args.numJobs);
+            }
+        }
+        else
+        {
+            std::cerr << "Primary hit cache disabled, the camera has depth of field or motion blur.\n";
+        }
+    }
+
+    uint32_t iteration = 0;
+
+    for (uint32_t pass = 0; pass < args.samplesPerPixel;)
+    {
+        bool training = pass < trainingPasses;
+        bool caching = pass < cachePasses;
+        uint32_t numPasses = args.samplesPerPixel - pass;
+
+        // The guide used after training is learnt from the last iteration alone, so that one takes whatever is left
+        // of the training budget once it can't be doubled again
+        if (training)
+        {
+            numPasses = (trainingPasses - pass < 2u << iteration) ? trainingPasses - pass : 1u << iteration;
+        }
+
+        numPasses = caching ? std::min(numPasses, cachePasses - pass) : numPasses;
+        integrator.setGuide(guide, training);
+        integrator.setRadianceCache(cache, caching);
+
+        if (photonMap)
+        {
+            numPasses = std::min(numPasses, std::max(MaxPhotonsPerBuild / args.photons, 1u));
+            photonMap->build(scene, pass, numPasses, args.numJobs);
+            integrator.setPhotonMap(photonMap);
+        }
+
+        nextRow = int(args.imageHeight);
+
+        for (Job& j : jobs)
+        {
+            j.run(scene, integrator, wavefront.get(), primaryHits.get(), pass, numPasses);
+        }
+
+        for (Job& j : jobs)
+        {
+            j.wait();
+        }
+
+        if (training)
+        {
+            guide->refine(iteration++);
+        }
+
+        pass += numPasses;
     }
 
     image /= args.samplesPerPixel;
@@ -205,4 +542,11 @@ int main(int argc, char** argv)
     image.saveHDR(args.outputName + ".hdr");
     image.save(args.outputName + ".png");
     std::cerr << "\nDone. " << duration << " seconds.\n";
+
+    if (wavefront)
+    {
+        wavefront->printStats(std::cerr);
+    }
+
+    TextureCache::get().printStats(std::cerr);
 }
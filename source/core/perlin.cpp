@@ -2,6 +2,8 @@
 
 #include "core/rng.h"
 
+#include <cmath>
+
 static int* generatePerm(int pointCount, Rng& rng);
 static void permute(int* p, int n, Rng& rng);
 static double perlinInterp(Vec3 c[2][2][2], double u, double v, double w);
@@ -54,17 +56,63 @@ double Perlin::noise(const Vec3& p) const
     return perlinInterp(c, u, v, w);
 }
 
-double Perlin::turb(const Vec3& p, int depth ) const
+double Perlin::turb(const Vec3& p, int depth) const
 {
+    // Each octave doubles p, so its cell and the fractions within it follow from the last octave's without another
+    // floor(). Doubling and dropping the integer part are exact, so they match what noise() works out for 2^octave * p.
+    double fx = std::floor(p.x);
+    double fy = std::floor(p.y);
+    double fz = std::floor(p.z);
+    double u = p.x - fx;
+    double v = p.y - fy;
+    double w = p.z - fz;
+    int i = static_cast<int>(fx) & 255;
+    int j = static_cast<int>(fy) & 255;
+    int k = static_cast<int>(fz) & 255;
     double accum = 0;
-    Vec3 temp_p = p;
     double weight = 1;
 
-    for (int i = 0; i < depth; i++)
+    for (int octave = 0; octave < depth; octave++)
     {
-        accum += weight * noise(temp_p);
+        double uu = u * u * (3 - 2 * u);
+        double vv = v * v * (3 - 2 * v);
+        double ww = w * w * (3 - 2 * w);
+        int z0 = zperm_[k];
+        int z1 = zperm_[(k + 1) & 255];
+        double terms[8];
+
+        // Corners in the order perlinInterp() visits them, each term rounded the same way
+        for (int n = 0; n < 4; n++)
+        {
+            int di = n >> 1;
+            int dj = n & 1;
+            int hash = xperm_[(i + di) & 255] ^ yperm_[(j + dj) & 255];
+            const Vec3& g0 = ranvec_[hash ^ z0];
+            const Vec3& g1 = ranvec_[hash ^ z1];
+            double weightXY = (di ? uu : 1 - uu) * (dj ? vv : 1 - vv);
+            terms[n * 2] = weightXY * (1 - ww) * dot(g0, Vec3(u - di, v - dj, w));
+            terms[n * 2 + 1] = weightXY * ww * dot(g1, Vec3(u - di, v - dj, w - 1));
+        }
+
+        double sum = 0.0;
+
+        for (int n = 0; n < 8; n++)
+        {
+            sum += terms[n];
+        }
+
+        accum += weight * sum;
         weight *= 0.5;
-        temp_p *= 2;
+
+        int carryU = static_cast<int>(2 * u);
+        int carryV = static_cast<int>(2 * v);
+        int carryW = static_cast<int>(2 * w);
+        u = 2 * u - carryU;
+        v = 2 * v - carryV;
+        w = 2 * w - carryW;
+        i = (2 * i + carryU) & 255;
+        j = (2 * j + carryV) & 255;
+        k = (2 * k + carryW) & 255;
     }
 
     return std::abs(accum);
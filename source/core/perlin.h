@@ -11,10 +11,14 @@ public:
     ~Perlin();
 
     double noise(const Vec3& p) const;
+
+    // Sum of depth octaves of noise, equal to adding up noise(2^octave * p) / 2^octave. Each octave's cell follows from
+    // the last one's without calling floor().
     double turb(const Vec3& p, int depth = 7) const;
 
 private:
     static const int pointCount = 256;
+
     Vec3* ranvec_;
     int* xperm_;
     int* yperm_;
@@ -2,7 +2,7 @@
 
 #include "core/vec3.h"
 
-struct Rng;
+class Sampler;
 
 class Ray
 {
@@ -11,11 +11,17 @@ public:
     Vec3 direction;
     double time;
     bool primary;
-    Rng* rng;
+    Sampler* sampler;
+    bool shadow{ false };   // Only looks for surfaces, media are accounted for by IHittable::transmittance() instead
+
+    // Ray cone standing in for the ray's differentials: the footprint is coneWidth across at the origin and widens by
+    // coneSpread per unit of distance. Zero for rays that don't filter what they find.
+    double coneWidth{ 0.0 };
+    double coneSpread{ 0.0 };
 
     Ray() = default;
     Ray(const Ray&) = default;
-    Ray(const Vec3& origin_, const Vec3& direction_, double time_, bool primary_, Rng* rng_) : origin(origin_), direction(direction_), time(time_), primary(primary_), rng(rng_) {}
+    Ray(const Vec3& origin_, const Vec3& direction_, double time_, bool primary_, Sampler* sampler_, bool shadow_ = false) : origin(origin_), direction(direction_), time(time_), primary(primary_), sampler(sampler_), shadow(shadow_) {}
 
     Ray& operator=(const Ray&) = default;
 
@@ -23,4 +29,10 @@ public:
     {
         return origin + direction * t;
     }
+
+    // Width of the footprint t along a unit length direction
+    double footprint(double t) const
+    {
+        return coneWidth + coneSpread * t;
+    }
 };
@@ -0,0 +1,105 @@
+#include "ray_packet.h"
+
+#include <algorithm>
+#include <cmath>
+
+void RayPacket::computeBounds()
+{
+    for (uint32_t i = 0; i < size; ++i)
+    {
+        for (int a = 0; a < 3; ++a)
+        {
+            // Same reciprocal as Aabb::hit(), so tests against it give the same results
+            origins[a][i] = rays[i].origin[a];
+            invDirections[a][i] = 1.0 / rays[i].direction[a];
+        }
+    }
+
+    coherent = size > 0;
+
+    for (int a = 0; a < 3 && coherent; ++a)
+    {
+        originMin[a] = originMax[a] = origins[a][0];
+        invDirectionMin[a] = invDirectionMax[a] = invDirections[a][0];
+
+        for (uint32_t i = 1; i < size; ++i)
+        {
+            originMin[a] = std::min(originMin[a], origins[a][i]);
+            originMax[a] = std::max(originMax[a], origins[a][i]);
+            invDirectionMin[a] = std::min(invDirectionMin[a], invDirections[a][i]);
+            invDirectionMax[a] = std::max(invDirectionMax[a], invDirections[a][i]);
+        }
+
+        coherent = (invDirectionMin[a] > 0.0 || invDirectionMax[a] < 0.0) && std::isfinite(invDirectionMin[a]) &&
+                   std::isfinite(invDirectionMax[a]);
+    }
+}
+
+PacketOverlap RayPacket::overlap(const Aabb& box, double tMin, double tMaxLo, double tMaxHi) const
+{
+    if (!coherent)
+    {
+        return PacketOverlap::Some;
+    }
+
+    // Bounds on where Aabb::hit() leaves tMin and tMax for any of the rays
+    double tMinLo = tMin;
+    double tMinHi = tMin;
+
+    for (int a = 0; a < 3; ++a)
+    {
+        // Rounding is monotonic, so a product of two ranges is bounded by the products of their ends
+        double minsLo = box.mins[a] - originMax[a];
+        double minsHi = box.mins[a] - originMin[a];
+        double maxsLo = box.maxs[a] - originMax[a];
+        double maxsHi = box.maxs[a] - originMin[a];
+        double t0[4] = { minsLo * invDirectionMin[a], minsLo * invDirectionMax[a], minsHi * invDirectionMin[a], minsHi * invDirectionMax[a] };
+        double t1[4] = { maxsLo * invDirectionMin[a], maxsLo * invDirectionMax[a], maxsHi * invDirectionMin[a], maxsHi * invDirectionMax[a] };
+        double t0Lo = std::min(std::min(t0[0], t0[1]), std::min(t0[2], t0[3]));
+        double t0Hi = std::max(std::max(t0[0], t0[1]), std::max(t0[2], t0[3]));
+        double t1Lo = std::min(std::min(t1[0], t1[1]), std::min(t1[2], t1[3]));
+        double t1Hi = std::max(std::max(t1[0], t1[1]), std::max(t1[2], t1[3]));
+
+        // Rays enter the slab through its near plane and leave through its far one
+        bool positive = invDirectionMin[a] > 0.0;
+        tMinLo = std::max(tMinLo, positive ? t0Lo : t1Lo);
+        tMinHi = std::max(tMinHi, positive ? t0Hi : t1Hi);
+        tMaxLo = std::min(tMaxLo, positive ? t1Lo : t0Lo);
+        tMaxHi = std::min(tMaxHi, positive ? t1Hi : t0Hi);
+
+        if (tMaxHi <= tMinLo)
+        {
+            return PacketOverlap::None;
+        }
+    }
+
+    // Aabb::hit() fails as soon as its range is empty, but the range only ever shrinks, so checking the final one is enough
+    return (tMaxLo > tMinHi) ? PacketOverlap::All : PacketOverlap::Some;
+}
+
+uint32_t RayPacket::hitMask(const Aabb& box, uint32_t active, double tMin, const double* tMax) const
+{
+    uint32_t result = 0;
+
+    for (uint32_t i = 0; i < size; ++i)
+    {
+        double rayMin = tMin;
+        double rayMax = tMax[i];
+
+        // Aabb::hit() stops at the first axis that empties its range, which stays empty as the later axes only shrink
+        // it further, so testing once at the end gives the same answer
+        for (int a = 0; a < 3; ++a)
+        {
+            double t0 = (box.mins[a] - origins[a][i]) * invDirections[a][i];
+            double t1 = (box.maxs[a] - origins[a][i]) * invDirections[a][i];
+            double tNear = invDirections[a][i] < 0.0 ? t1 : t0;
+            double tFar = invDirections[a][i] < 0.0 ? t0 : t1;
+            rayMin = tNear > rayMin ? tNear : rayMin;
+            rayMax = tFar < rayMax ? tFar : rayMax;
+        }
+
+        result |= uint32_t(rayMax > rayMin) << i;
+    }
+
+    return result & active;
+}
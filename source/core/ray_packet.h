@@ -0,0 +1,48 @@
+#pragma once
+
+#include "core/aabb.h"
+#include "core/ray.h"
+#include "core/vec3.h"
+
+#include <cstdint>
+
+// Largest number of rays traced together, each gets a bit in the active masks passed through the traversal
+constexpr uint32_t MaxPacketSize = 16;
+
+// How the rays of a packet meet a bounding box, as far as interval arithmetic can tell
+enum class PacketOverlap
+{
+    None,       // Every ray misses it
+    Some,       // Undecided, the rays have to be tested one at a time
+    All         // Every ray hits it
+};
+
+// Neighbouring rays traced through the scene together (e.g. the camera rays of a few adjacent pixels). Bounding boxes
+// that all or none of them hit are decided with one interval arithmetic test instead of one test per ray.
+struct RayPacket
+{
+    // Call once the rays are filled in
+    void computeBounds();
+
+    // Classifies box against the rays whose tMax lies in [tMaxLo, tMaxHi]. The answer agrees with Aabb::hit() for every
+    // one of them, rounding included. Incoherent packets always get Some.
+    PacketOverlap overlap(const Aabb& box, double tMin, double tMaxLo, double tMaxHi) const;
+
+    // The rays of active that box.hit() accepts, ray i within [tMin, tMax[i]]. Works on all of them at once, without
+    // recomputing reciprocal directions, so the loop can be vectorised.
+    uint32_t hitMask(const Aabb& box, uint32_t active, double tMin, const double* tMax) const;
+
+    Ray rays[MaxPacketSize];
+    uint32_t size{ 0 };
+
+    // Per axis copies of the origins and reciprocal directions, laid out for hitMask()
+    double origins[3][MaxPacketSize];
+    double invDirections[3][MaxPacketSize];
+
+    // Set when every axis has direction components of a single, non-zero sign, which the interval tests rely on
+    bool coherent{ false };
+    Vec3 originMin;
+    Vec3 originMax;
+    Vec3 invDirectionMin;
+    Vec3 invDirectionMax;
+};
@@ -1,28 +1,56 @@
 #pragma once
 
-#include <random>
+#include <cstdint>
 
 #include "core/rtiow.h"
 
+// SplitMix64 finalizer; turns structured keys (pixel, sample index, ...) into well mixed seeds
+inline uint64_t mixBits(uint64_t x)
+{
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ull;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebull;
+    x ^= x >> 31;
+    return x;
+}
+
+// PCG32 (O'Neill 2014, "PCG: A Family of Simple Fast Space-Efficient Statistically Good Algorithms for Random Number
+// Generation"). Sixteen bytes of state, so it is cheap to reseed for every pixel sample.
 struct Rng
 {
     Rng()
-        : distribution_(0, 1)
+        : Rng(0)
+    {
+    }
+
+    Rng(uint64_t seed, uint64_t stream = 0)
+    {
+        setSeed(seed, stream);
+    }
+
+    void setSeed(uint64_t seed, uint64_t stream = 0)
     {
-        std::random_device rd;
-        std::seed_seq ss({ rd(), rd(), rd(), rd(), rd(), rd() });
-        generator_.seed(ss);
+        state_ = 0;
+        inc_ = (stream << 1) | 1;
+        next();
+        state_ += seed;
+        next();
     }
 
-    Rng(unsigned int seed)
-        : Rng()
+    uint32_t next()
     {
-        generator_.seed(seed);
+        uint64_t old = state_;
+        state_ = old * 6364136223846793005ull + inc_;
+        uint32_t xorShifted = uint32_t(((old >> 18) ^ old) >> 27);
+        uint32_t rot = uint32_t(old >> 59);
+        return (xorShifted >> rot) | (xorShifted << ((32 - rot) & 31));
     }
 
+    // Uniform in [0, 1)
     double operator()()
     {
-        return distribution_(generator_);
+        return double(next()) * 0x1p-32;
     }
 
     double operator()(double min, double max)
@@ -30,9 +58,12 @@ struct Rng
         return lerp(min, max, operator()());
     }
 
+    // Uniform in [min, max] by fixed point multiply (Lemire), without a rejection loop; the bias is negligible for the
+    // small ranges used here
     int randomInt(int min, int max)
     {
-        return int(operator()(double(min), double(max) + 1.0));
+        uint64_t range = uint64_t(int64_t(max) - int64_t(min) + 1);
+        return min + int((uint64_t(next()) * range) >> 32);
     }
 
     Vec3 color()
@@ -45,32 +76,6 @@ struct Rng
         return Vec3{ operator()(min, max), operator()(min, max), operator()(min, max) };
     }
 
-    Vec3 inUnitSphere()
-    {
-        for (;;)
-        {
-            Vec3 v = { operator()(-1, 1), operator()(-1, 1), operator()(-1, 1) };
-
-            if (length2(v) < 1)
-            {
-                return v;
-            }
-        }
-    }
-
-    Vec3 inUnitDisk()
-    {
-        for (;;)
-        {
-            Vec3 v = Vec3(operator()(-1,1), operator()(-1,1), 0);
-
-            if (length2(v) < 1)
-            {
-                return v;
-            }
-        }
-    }
-
-    std::uniform_real_distribution<double> distribution_;
-    std::mt19937 generator_;
+    uint64_t state_;
+    uint64_t inc_;
 };
@@ -2,6 +2,8 @@
 
 #include "vec3.h"
 
+#include <cmath>
+
 template<typename T>
 T lerp(const T& from, const T& to, double t)
 {
@@ -20,3 +22,13 @@ constexpr double degToRad(double deg)
 {
     return deg * pi / 180.0;
 }
+
+// Orthonormal basis around a unit vector (Duff et al. 2017, "Building an Orthonormal Basis, Revisited")
+inline void makeBasis(const Vec3& n, Vec3& s, Vec3& t)
+{
+    double sign = std::copysign(1.0, n.z);
+    double a = -1.0 / (sign + n.z);
+    double b = n.x * n.y * a;
+    s = Vec3(1.0 + sign * n.x * n.x * a, sign * b, -sign * n.x);
+    t = Vec3(b, sign + n.y * n.y * a, -n.y);
+}
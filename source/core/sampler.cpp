@@ -0,0 +1,416 @@
+#include "sampler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+// Pairs of dimensions available to each decision before they start to overlap the next one
+constexpr uint32_t PairsPerDimension = 64;
+
+constexpr int BlueNoiseSize = 64;
+
+// Largest double below one, keeps numbers rescaled by choose() in [0, 1)
+constexpr double OneMinusEpsilon = 0x1.fffffffffffffp-1;
+
+static uint32_t hash(uint32_t x)
+{
+    // lowbias32 by Chris Wellons
+    x ^= x >> 16;
+    x *= 0x7feb352d;
+    x ^= x >> 15;
+    x *= 0x846ca68b;
+    x ^= x >> 16;
+    return x;
+}
+
+static uint32_t hash(uint32_t a, uint32_t b)
+{
+    return hash(a ^ (hash(b) + 0x9e3779b9 + (a << 6) + (a >> 2)));
+}
+
+static uint32_t reverseBits(uint32_t x)
+{
+    x = (x << 16) | (x >> 16);
+    x = ((x & 0x00ff00ff) << 8) | ((x & 0xff00ff00) >> 8);
+    x = ((x & 0x0f0f0f0f) << 4) | ((x & 0xf0f0f0f0) >> 4);
+    x = ((x & 0x33333333) << 2) | ((x & 0xcccccccc) >> 2);
+    x = ((x & 0x55555555) << 1) | ((x & 0xaaaaaaaa) >> 1);
+    return x;
+}
+
+static uint32_t laineKarrasPermutation(uint32_t x, uint32_t seed)
+{
+    x ^= x * 0x3d20adea;
+    x += seed;
+    x *= (seed >> 16) | 1;
+    x ^= x * 0x05526c56;
+    x ^= x * 0x53a22864;
+    return x;
+}
+
+static uint32_t nestedUniformScramble(uint32_t x, uint32_t seed)
+{
+    return reverseBits(laineKarrasPermutation(reverseBits(x), seed));
+}
+
+// First two Sobol dimensions, the second has all direction numbers m_k = 1
+static uint32_t sobol0(uint32_t index)
+{
+    return reverseBits(index);
+}
+
+static uint32_t sobol1(uint32_t index)
+{
+    uint32_t result = 0;
+
+    for (uint32_t v = 1u << 31; index; index >>= 1, v ^= v >> 1)
+    {
+        if (index & 1)
+        {
+            result ^= v;
+        }
+    }
+
+    return result;
+}
+
+static double toUnit(uint32_t x)
+{
+    return double(x) * (1.0 / 4294967296.0);
+}
+
+// Owen scrambled Sobol point, the sample order is shuffled too so that every dimension pair gets its own ordering
+static void scrambledSobol(uint32_t sampleIndex, uint32_t seed, uint32_t& x, uint32_t& y)
+{
+    uint32_t index = nestedUniformScramble(sampleIndex, seed);
+    x = nestedUniformScramble(sobol0(index), hash(seed, 0x4c11db7));
+    y = nestedUniformScramble(sobol1(index), hash(seed, 0x1edc6f41));
+}
+
+// Void-and-cluster (Ulichney 1993) rank mask, with the last phase simplified to keep filling the largest void
+static std::vector<double> generateBlueNoise()
+{
+    constexpr int size = BlueNoiseSize;
+    constexpr int count = size * size;
+    constexpr double sigma = 1.5;
+
+    std::vector<double> kernel(count);
+
+    for (int y = 0; y < size; ++y)
+    {
+        for (int x = 0; x < size; ++x)
+        {
+            double dx = std::min(x, size - x);
+            double dy = std::min(y, size - y);
+            kernel[x + y * size] = std::exp(-(dx * dx + dy * dy) / (2.0 * sigma * sigma));
+        }
+    }
+
+    std::vector<uint8_t> pattern(count, 0);
+    std::vector<double> energy(count, 0.0);
+
+    auto splat = [&](int index, double sign)
+    {
+        int px = index % size;
+        int py = index / size;
+
+        for (int y = 0; y < size; ++y)
+        {
+            for (int x = 0; x < size; ++x)
+            {
+                energy[x + y * size] += sign * kernel[((x - px) & (size - 1)) + ((y - py) & (size - 1)) * size];
+            }
+        }
+    };
+
+    auto tightestCluster = [&]()
+    {
+        int best = -1;
+
+        for (int i = 0; i < count; ++i)
+        {
+            if (pattern[i] && (best < 0 || energy[i] > energy[best]))
+            {
+                best = i;
+            }
+        }
+
+        return best;
+    };
+
+    auto largestVoid = [&]()
+    {
+        int best = -1;
+
+        for (int i = 0; i < count; ++i)
+        {
+            if (!pattern[i] && (best < 0 || energy[i] < energy[best]))
+            {
+                best = i;
+            }
+        }
+
+        return best;
+    };
+
+    // Random initial pattern, relaxed by moving the tightest cluster into the largest void until that's a no-op. Ties
+    // between equal energies could in principle cycle, so the relaxation gives up after one move per pixel.
+    Rng rng(0x626c7565);
+    int initialCount = count / 10;
+
+    for (int placed = 0; placed < initialCount;)
+    {
+        int i = rng.randomInt(0, count - 1);
+
+        if (!pattern[i])
+        {
+            pattern[i] = 1;
+            splat(i, 1.0);
+            ++placed;
+        }
+    }
+
+    for (int iteration = 0; iteration < count; ++iteration)
+    {
+        int cluster = tightestCluster();
+        pattern[cluster] = 0;
+        splat(cluster, -1.0);
+
+        int largest = largestVoid();
+        pattern[largest] = 1;
+        splat(largest, 1.0);
+
+        if (largest == cluster)
+        {
+            break;
+        }
+    }
+
+    std::vector<int> rank(count);
+    std::vector<uint8_t> prototype = pattern;
+    std::vector<double> prototypeEnergy = energy;
+
+    for (int r = initialCount - 1; r >= 0; --r)
+    {
+        int cluster = tightestCluster();
+        pattern[cluster] = 0;
+        splat(cluster, -1.0);
+        rank[cluster] = r;
+    }
+
+    pattern = prototype;
+    energy = prototypeEnergy;
+
+    for (int r = initialCount; r < count; ++r)
+    {
+        int largest = largestVoid();
+        pattern[largest] = 1;
+        splat(largest, 1.0);
+        rank[largest] = r;
+    }
+
+    std::vector<double> mask(count);
+
+    for (int i = 0; i < count; ++i)
+    {
+        mask[i] = (rank[i] + 0.5) / count;
+    }
+
+    return mask;
+}
+
+static double blueNoise(uint32_t x, uint32_t y)
+{
+    static const std::vector<double> mask = generateBlueNoise();
+    return mask[(x & (BlueNoiseSize - 1)) + (y & (BlueNoiseSize - 1)) * BlueNoiseSize];
+}
+
+void Sampler::startPixelSample(uint32_t x, uint32_t y, uint32_t sampleIndex)
+{
+    pixelX_ = x;
+    pixelY_ = y;
+    pixelSampleIndex_ = sampleIndex;
+    sampleIndex_ = sampleIndex;
+    startDimension(0, Dimension::Camera);
+}
+
+void Sampler::startSplit(uint32_t split, uint32_t numSplits)
+{
+    sampleIndex_ = pixelSampleIndex_ * numSplits + split;
+}
+
+void Sampler::startDimension(uint32_t bounce, Dimension dimension)
+{
+    dimension_ = (bounce * uint32_t(Dimension::Count) + uint32_t(dimension)) * PairsPerDimension;
+    draw_ = 0;
+    hasReplay_ = false;
+}
+
+Sampler::State Sampler::state() const
+{
+    return State{ dimension_, draw_, pending_, replay_, hasReplay_, overflow_, Rng() };
+}
+
+void Sampler::restore(const State& state)
+{
+    dimension_ = state.dimension;
+    draw_ = state.draw;
+    pending_ = state.pending;
+    replay_ = state.replay;
+    hasReplay_ = state.hasReplay;
+    overflow_ = state.overflow;
+}
+
+double Sampler::sample1D()
+{
+    // Skip the unused half of a pair that was started, then drop the second half of this one
+    draw_ += draw_ & 1;
+    double u = operator()();
+    ++draw_;
+    return u;
+}
+
+bool Sampler::choose(double probability)
+{
+    double u = operator()();
+    bool first = u < probability;
+    replay_ = std::min(first ? u / probability : (u - probability) / (1.0 - probability), OneMinusEpsilon);
+    hasReplay_ = true;
+    return first;
+}
+
+double Sampler::operator()()
+{
+    if (hasReplay_)
+    {
+        hasReplay_ = false;
+        return replay_;
+    }
+
+    if (draw_++ & 1)
+    {
+        return pending_;
+    }
+
+    // Long walks (e.g. tracking through a thick medium) carry on with independent numbers once the decision's pairs are
+    // used up, rather than wrapping around to the first ones
+    uint32_t pair = draw_ / 2;
+
+    if (pair >= PairsPerDimension)
+    {
+        if (pair == PairsPerDimension)
+        {
+            uint64_t pixel = (uint64_t(pixelY_) << 32) | pixelX_;
+            uint64_t sample = (uint64_t(seed_) << 32) | sampleIndex_;
+            overflow_.setSeed(mixBits(pixel ^ mixBits(sample)), dimension_);
+        }
+
+        double u = overflow_();
+        pending_ = overflow_();
+        return u;
+    }
+
+    double u0;
+    sample2D(dimension_ + pair, u0, pending_);
+    return u0;
+}
+
+void RandomSampler::startPixelSample(uint32_t x, uint32_t y, uint32_t sampleIndex)
+{
+    uint64_t pixel = (uint64_t(y) << 32) | x;
+    uint64_t sample = (uint64_t(seed_) << 32) | sampleIndex;
+    pathSeed_ = mixBits(pixel ^ mixBits(sample));
+    rng_.setSeed(pathSeed_);
+    Sampler::startPixelSample(x, y, sampleIndex);
+}
+
+void RandomSampler::startDimension(uint32_t bounce, Dimension dimension)
+{
+    Sampler::startDimension(bounce, dimension);
+
+    if (independentDimensions_)
+    {
+        rng_.setSeed(pathSeed_, uint64_t(bounce) * uint32_t(Dimension::Count) + uint32_t(dimension));
+    }
+}
+
+void RandomSampler::startSplit(uint32_t split, uint32_t numSplits)
+{
+    // Split paths differ from the unsplit one and each other in their seed
+    Sampler::startSplit(split, numSplits);
+    uint64_t pixel = (uint64_t(pixelY_) << 32) | pixelX_;
+    uint64_t sample = (uint64_t(seed_) << 32) | pixelSampleIndex_;
+    pathSeed_ = mixBits(pixel ^ mixBits(sample) ^ mixBits(uint64_t(split) + 1));
+    rng_.setSeed(pathSeed_);
+}
+
+Sampler::State RandomSampler::state() const
+{
+    State state = Sampler::state();
+    state.rng = rng_;
+    return state;
+}
+
+void RandomSampler::restore(const State& state)
+{
+    Sampler::restore(state);
+    rng_ = state.rng;
+}
+
+void RandomSampler::sample2D(uint32_t dimension, double& u0, double& u1)
+{
+    u0 = rng_();
+    u1 = rng_();
+}
+
+void SobolSampler::startPixelSample(uint32_t x, uint32_t y, uint32_t sampleIndex)
+{
+    Sampler::startPixelSample(x, y, sampleIndex);
+    pixelSeed_ = hash(hash(x, y), seed_);
+}
+
+void SobolSampler::sample2D(uint32_t dimension, double& u0, double& u1)
+{
+    uint32_t x;
+    uint32_t y;
+    scrambledSobol(sampleIndex_, hash(pixelSeed_, dimension), x, y);
+    u0 = toUnit(x);
+    u1 = toUnit(y);
+}
+
+void BlueNoiseSampler::sample2D(uint32_t dimension, double& u0, double& u1)
+{
+    uint32_t seed = hash(seed_, dimension);
+    uint32_t x;
+    uint32_t y;
+    scrambledSobol(sampleIndex_, seed, x, y);
+
+    // Cranley-Patterson rotation by the mask, read at a different toroidal offset for each coordinate
+    uint32_t offset = hash(seed);
+    double shift0 = blueNoise(pixelX_ + (offset & 0xff), pixelY_ + ((offset >> 8) & 0xff));
+    double shift1 = blueNoise(pixelX_ + ((offset >> 16) & 0xff), pixelY_ + (offset >> 24));
+    u0 = toUnit(x) + shift0;
+    u1 = toUnit(y) + shift1;
+    u0 -= (u0 >= 1.0) ? 1.0 : 0.0;
+    u1 -= (u1 >= 1.0) ? 1.0 : 0.0;
+}
+
+std::unique_ptr<Sampler> createSampler(std::string_view name, uint32_t seed)
+{
+    if (name == "random")
+    {
+        return std::make_unique<RandomSampler>(seed);
+    }
+
+    if (name == "sobol")
+    {
+        return std::make_unique<SobolSampler>(seed);
+    }
+
+    if (name == "bluenoise")
+    {
+        return std::make_unique<BlueNoiseSampler>(seed);
+    }
+
+    return nullptr;
+}
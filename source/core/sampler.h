@@ -0,0 +1,188 @@
+#pragma once
+
+#include "core/rng.h"
+#include "core/rtiow.h"
+
+#include <cstdint>
+#include <memory>
+#include <string_view>
+
+// Source of the uniform numbers used to build a path. Consecutive pairs of draws come from one 2D point set, so code
+// that takes two samples for a 2D decision (lens position, BSDF direction, ...) gets them stratified together.
+class Sampler
+{
+public:
+    // Each bounce gets its own block of dimensions per decision, so e.g. the BSDF direction at the second bounce always
+    // uses the same dimensions no matter how many samples other decisions consumed.
+    enum class Dimension : uint32_t
+    {
+        Camera,
+        Medium,
+        Bsdf,
+        Light,
+        Sky,
+        Roulette,
+        Cache,
+        Count
+    };
+
+    // seed selects an independent pattern, e.g. the frame number of an animation
+    explicit Sampler(uint32_t seed)
+        : seed_(seed)
+    {
+    }
+
+    virtual ~Sampler() = default;
+
+    // A sampler in the same state, e.g. for a wavefront workspace that draws apart from the job's own sampler
+    virtual std::unique_ptr<Sampler> clone() const = 0;
+
+    // Everything drawn until the next call is a pure function of (seed, x, y, sampleIndex), so images don't depend on
+    // which thread renders which pixel
+    virtual void startPixelSample(uint32_t x, uint32_t y, uint32_t sampleIndex);
+    virtual void startDimension(uint32_t bounce, Dimension dimension);
+
+    // Where the draws of the current dimension are up to, for decisions that are finished later than they were started
+    // (e.g. the shadow rays of a wavefront). restore() carries on from there once startPixelSample() has gone back to
+    // the same pixel sample.
+    struct State
+    {
+        uint32_t dimension;
+        uint32_t draw;
+        double pending;
+        double replay;
+        bool hasReplay;
+        Rng overflow;
+        Rng rng;            // For samplers that draw from a generator
+    };
+
+    virtual State state() const;
+    virtual void restore(const State& state);
+
+    // Makes every dimension draw the same numbers however many were drawn from the others, so that a path's dimensions
+    // can be visited out of order. Samplers whose points only depend on the dimension always do.
+    virtual void setIndependentDimensions(bool independent) {}
+
+    // The sampleIndex of the last startPixelSample(), splits don't change it
+    uint32_t pixelSampleIndex() const { return pixelSampleIndex_; }
+
+    // Switches to the split-th of numSplits paths continued from the current camera ray. Their draws are consecutive
+    // samples of a set numSplits times larger, so the paths stay stratified against each other and against the other
+    // pixel samples.
+    virtual void startSplit(uint32_t split, uint32_t numSplits);
+
+    double operator()();
+
+    // A number from a 2D point of its own, for a 1D decision that's followed by 2D ones (e.g. picking the light that
+    // then samples a direction). Drawing it with operator() would pair the following decision's first number with
+    // this one and its second number with the next point.
+    double sample1D();
+
+    // Picks between two strategies with the next number, then hands that number out again rescaled to [0, 1) within
+    // the side it fell on. Both strategies thus draw from the same stratified point, which picking with a number of
+    // its own would scatter between them.
+    bool choose(double probability);
+
+    double operator()(double min, double max)
+    {
+        return lerp(min, max, operator()());
+    }
+
+protected:
+    // Returns point sampleIndex_ of the 2D point set identified by dimension for the current pixel
+    virtual void sample2D(uint32_t dimension, double& u0, double& u1) = 0;
+
+    uint32_t seed_;
+    uint32_t pixelX_{ 0 };
+    uint32_t pixelY_{ 0 };
+    uint32_t pixelSampleIndex_{ 0 };
+    uint32_t sampleIndex_{ 0 };     // Differs from pixelSampleIndex_ when the path was split
+
+private:
+    uint32_t dimension_{ 0 };
+    uint32_t draw_{ 0 };
+    double pending_{ 0.0 };
+    double replay_{ 0.0 };
+    bool hasReplay_{ false };
+    Rng overflow_;      // Draws past the last pair of the current dimension
+};
+
+// Independent uniform random numbers, from a generator reseeded for every pixel sample
+class RandomSampler : public Sampler
+{
+public:
+    using Sampler::Sampler;
+
+    std::unique_ptr<Sampler> clone() const override { return std::make_unique<RandomSampler>(*this); }
+    void startPixelSample(uint32_t x, uint32_t y, uint32_t sampleIndex) override;
+    void startDimension(uint32_t bounce, Dimension dimension) override;
+    void startSplit(uint32_t split, uint32_t numSplits) override;
+    State state() const override;
+    void restore(const State& state) override;
+    void setIndependentDimensions(bool independent) override { independentDimensions_ = independent; }
+
+protected:
+    void sample2D(uint32_t dimension, double& u0, double& u1) override;
+
+private:
+    // One stream per path, or with independent dimensions one per dimension of the path, reseeded when it starts
+    Rng rng_;
+    uint64_t pathSeed_{ 0 };
+    bool independentDimensions_{ false };
+};
+
+// Padded Sobol (0,2) sequence, with the sample order and each coordinate Owen scrambled per pixel and dimension pair
+// (Burley 2020, "Practical Hash-based Owen Scrambling")
+class SobolSampler : public Sampler
+{
+public:
+    using Sampler::Sampler;
+
+    std::unique_ptr<Sampler> clone() const override { return std::make_unique<SobolSampler>(*this); }
+    void startPixelSample(uint32_t x, uint32_t y, uint32_t sampleIndex) override;
+
+protected:
+    void sample2D(uint32_t dimension, double& u0, double& u1) override;
+
+private:
+    uint32_t pixelSeed_{ 0 };
+};
+
+// The same Sobol points for every pixel, toroidally shifted by a blue noise mask (Georgiev & Fajardo 2016, "Blue-noise
+// Dithered Sampling"). Neighbouring pixels get decorrelated offsets, which pushes the error into high frequencies.
+class BlueNoiseSampler : public Sampler
+{
+public:
+    using Sampler::Sampler;
+
+    std::unique_ptr<Sampler> clone() const override { return std::make_unique<BlueNoiseSampler>(*this); }
+
+protected:
+    void sample2D(uint32_t dimension, double& u0, double& u1) override;
+};
+
+// Stands in for a path's sampler while finding a hit that should be kept for later, noting whether anything drew from it.
+// Use a fresh one per ray, one carried over could hand out the second half of a pair without noticing.
+class DrawDetector : public Sampler
+{
+public:
+    DrawDetector()
+        : Sampler(0)
+    {
+    }
+
+    std::unique_ptr<Sampler> clone() const override { return std::make_unique<DrawDetector>(*this); }
+
+    bool drawn{ false };
+
+protected:
+    void sample2D(uint32_t dimension, double& u0, double& u1) override
+    {
+        drawn = true;
+        u0 = 0.5;
+        u1 = 0.5;
+    }
+};
+
+// Returns nullptr for unknown names; accepts "random", "sobol" and "bluenoise"
+std::unique_ptr<Sampler> createSampler(std::string_view name, uint32_t seed);
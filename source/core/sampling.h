@@ -0,0 +1,58 @@
+#pragma once
+
+#include "core/rtiow.h"
+#include "core/vec3.h"
+
+#include <algorithm>
+#include <cmath>
+
+// Warps from uniform samples in [0, 1)^2 to common domains
+
+// Shirley-Chiu concentric mapping, returned in the xy plane. The wedge is picked with selects rather than branches.
+inline Vec3 squareToConcentricDisk(double u0, double u1)
+{
+    double a = 2.0 * u0 - 1.0;
+    double b = 2.0 * u1 - 1.0;
+    bool aMajor = a * a > b * b;
+    double r = aMajor ? a : b;
+
+    // r is only zero at the centre, where phi doesn't matter
+    double rSafe = (r == 0.0) ? 1.0 : r;
+    double phi = aMajor ? (pi / 4.0) * (b / rSafe) : (pi / 2.0) - (pi / 4.0) * (a / rSafe);
+
+    return Vec3(r * std::cos(phi), r * std::sin(phi), 0);
+}
+
+// Cosine weighted hemisphere around +z, pdf = cos(theta) / pi
+inline Vec3 squareToCosineHemisphere(double u0, double u1)
+{
+    Vec3 d = squareToConcentricDisk(u0, u1);
+    d.z = std::sqrt(std::max(0.0, 1.0 - d.x * d.x - d.y * d.y));
+    return d;
+}
+
+// Uniform unit sphere, pdf = 1 / (4 pi)
+inline Vec3 squareToUniformSphere(double u0, double u1)
+{
+    double z = 1.0 - 2.0 * u0;
+    double r = std::sqrt(std::max(0.0, 1.0 - z * z));
+    double phi = 2.0 * pi * u1;
+    return Vec3(r * std::cos(phi), r * std::sin(phi), z);
+}
+
+// Transforms a direction from the local frame around n (as +z) to world space
+inline Vec3 localToWorld(const Vec3& n, const Vec3& local)
+{
+    Vec3 s;
+    Vec3 t;
+    makeBasis(n, s, t);
+    return s * local.x + t * local.y + n * local.z;
+}
+
+// Veach's power heuristic (beta = 2) for combining two sampling strategies
+inline double powerHeuristic(double pdf, double otherPdf)
+{
+    double a = pdf * pdf;
+    double b = otherPdf * otherPdf;
+    return (a + b > 0) ? a / (a + b) : 0.0;
+}
@@ -3,36 +3,300 @@
 #include "sky.h"
 
 #include "core/rtiow.h"
+#include "core/sampler.h"
 
+#include <algorithm>
+#include <array>
 #include <cmath>
+#include <vector>
 
 #include "stb_image.h"
 
-HdriSky::~HdriSky()
+// Cells a side of the importance sampling distribution, larger maps share each cell between several texels
+constexpr int MaxDistributionSize = 1024;
+
+// Maps a direction of any length onto [0, 1)^2: projected onto the octahedron |x| + |y| + |z| = 1, with the lower half
+// folded out over the corners of the upper half's square
+static void octahedralEncode(const Vec3& d, double& u, double& v)
+{
+    double invL1 = 1.0 / (std::abs(d.x) + std::abs(d.y) + std::abs(d.z));
+    double x = d.x * invL1;
+    double z = d.z * invL1;
+
+    if (d.y < 0.0)
+    {
+        double foldedX = (1.0 - std::abs(z)) * (x >= 0.0 ? 1.0 : -1.0);
+        double foldedZ = (1.0 - std::abs(x)) * (z >= 0.0 ? 1.0 : -1.0);
+        x = foldedX;
+        z = foldedZ;
+    }
+
+    u = x * 0.5 + 0.5;
+    v = z * 0.5 + 0.5;
+}
+
+// Inverse of octahedralEncode(), returns a unit vector
+static Vec3 octahedralDecode(double u, double v)
+{
+    double x = u * 2.0 - 1.0;
+    double z = v * 2.0 - 1.0;
+    double y = 1.0 - std::abs(x) - std::abs(z);
+
+    if (y < 0.0)
+    {
+        double unfoldedX = (1.0 - std::abs(z)) * (x >= 0.0 ? 1.0 : -1.0);
+        double unfoldedZ = (1.0 - std::abs(x)) * (z >= 0.0 ? 1.0 : -1.0);
+        x = unfoldedX;
+        z = unfoldedZ;
+    }
+
+    return normalize(Vec3(x, y, z));
+}
+
+// Solid angle per unit of map area around unit direction d, the octahedron's faces are nearer the center than its
+// corners so they cover more of the sphere
+static double octahedralJacobian(const Vec3& d)
+{
+    double l1 = std::abs(d.x) + std::abs(d.y) + std::abs(d.z);
+    return 4.0 * l1 * l1 * l1;
+}
+
+static uint32_t toRgbe(const Vec3& color)
+{
+    double maxComponent = std::max(std::max(color.x, color.y), color.z);
+
+    if (maxComponent < 1e-32)
+    {
+        return 0;
+    }
+
+    int exponent;
+    double scale = std::frexp(maxComponent, &exponent) * 256.0 / maxComponent;
+    uint32_t r = uint32_t(std::max(color.x, 0.0) * scale);
+    uint32_t g = uint32_t(std::max(color.y, 0.0) * scale);
+    uint32_t b = uint32_t(std::max(color.z, 0.0) * scale);
+    return r | (g << 8) | (b << 16) | (uint32_t(exponent + 128) << 24);
+}
+
+// 2^(exponent - 136) for each stored exponent, the mantissas are 8 bit fixed point
+static const std::array<double, 256> RgbeScales = []()
 {
-    if (data_)
+    std::array<double, 256> result;
+
+    for (int e = 0; e < 256; ++e)
     {
-        stbi_image_free(data_);
+        result[e] = (e == 0) ? 0.0 : std::ldexp(1.0, e - 136);
     }
+
+    return result;
+}();
+
+static Vec3 fromRgbe(uint32_t rgbe)
+{
+    return Vec3(double(rgbe & 0xff), double((rgbe >> 8) & 0xff), double((rgbe >> 16) & 0xff)) * RgbeScales[rgbe >> 24];
 }
 
 bool HdriSky::load(std::string_view path)
 {
-    data_ = stbi_loadf(path.data(), &width_, &height_, nullptr, 0);
-    return !!data_;
+    int width;
+    int height;
+    float* data = stbi_loadf(path.data(), &width, &height, nullptr, 3);
+
+    if (!data)
+    {
+        return false;
+    }
+
+    // Bilinear lookup in the latitude-longitude image, wrapping around in longitude
+    auto source = [data, width, height](const Vec3& d)
+    {
+        double theta = std::acos(clamp(d.y, -1.0, 1.0));
+        double phi = std::atan2(d.z, d.x);
+        phi = (phi < 0) ? (phi + 2.0 * pi) : phi;
+        double x = phi / (2.0 * pi) * width - 0.5;
+        double y = clamp(theta / pi * height - 0.5, 0.0, double(height - 1));
+        int x0 = int(std::floor(x));
+        int y0 = int(y);
+        int y1 = std::min(y0 + 1, height - 1);
+        double fx = x - x0;
+        double fy = y - y0;
+
+        auto at = [data, width](int tx, int ty)
+        {
+            const float* texel = data + (((tx % width + width) % width) + size_t(ty) * width) * 3;
+            return Vec3(texel[0], texel[1], texel[2]);
+        };
+
+        return lerp(lerp(at(x0, y0), at(x0 + 1, y0), fx), lerp(at(x0, y1), at(x0 + 1, y1), fx), fy);
+    };
+
+    // Same number of texels as the source, so detail is kept roughly everywhere
+    int size = std::max(int(std::ceil(std::sqrt(double(width) * height))), 1);
+    size_t total = 0;
+    levels_.clear();
+
+    for (;;)
+    {
+        levels_.push_back({ size, total });
+        total += size_t(size) * size;
+
+        if (size == 1)
+        {
+            break;
+        }
+
+        size = std::max(size / 2, 1);
+    }
+
+    texels_.assign(total, 0);
+
+    // Luminance weighted by the solid angle of each texel
+    const Level& top = levels_[0];
+    int cells = std::min(top.size, MaxDistributionSize);
+    std::vector<double> importance(size_t(cells) * cells, 0.0);
+
+    for (int y = 0; y < top.size; ++y)
+    {
+        for (int x = 0; x < top.size; ++x)
+        {
+            Vec3 d = octahedralDecode((x + 0.5) / top.size, (y + 0.5) / top.size);
+            Vec3 color = source(d);
+            texels_[x + size_t(y) * top.size] = toRgbe(color);
+
+            double luminance = 0.2126 * color.x + 0.7152 * color.y + 0.0722 * color.z;
+            importance[size_t(x) * cells / top.size + size_t(y) * cells / top.size * cells] += luminance * octahedralJacobian(d);
+        }
+    }
+
+    stbi_image_free(data);
+    distribution_ = Distribution2D(importance.data(), cells, cells);
+
+    // Every other level averages the texels of the top one whose centers fall in each of its texels, weighted by their
+    // solid angle so that all the levels hold the same amount of light
+    size_t topTexels = size_t(top.size) * top.size;
+    std::vector<Vec3> sums(total - topTexels, Vec3(0, 0, 0));
+    std::vector<double> weights(sums.size(), 0.0);
+
+    for (int y = 0; y < top.size; ++y)
+    {
+        for (int x = 0; x < top.size; ++x)
+        {
+            Vec3 color = texel(top, x, y);
+            double weight = octahedralJacobian(octahedralDecode((x + 0.5) / top.size, (y + 0.5) / top.size));
+
+            for (size_t i = 1; i < levels_.size(); ++i)
+            {
+                const Level& level = levels_[i];
+                size_t cell = level.offset - topTexels + size_t(x) * level.size / top.size + size_t(y) * level.size / top.size * level.size;
+                sums[cell] += color * weight;
+                weights[cell] += weight;
+            }
+        }
+    }
+
+    for (size_t i = 0; i < sums.size(); ++i)
+    {
+        texels_[topTexels + i] = toRgbe(sums[i] / weights[i]);
+    }
+
+    return true;
 }
 
 Vec3 HdriSky::Sample(const Vec3& d) const
 {
-    double theta = std::acos(clamp(d.y, -1.0, 1.0));
-    double phi = std::atan2(d.z, d.x);
-    phi = (phi < 0) ? (phi + 2.0 * pi) : phi;
-    double u = phi / (2.0 * pi);
-    double v = theta / pi;
-    int x = int((width_ - 1) * u + 0.5);
-    int y = int((height_ - 1) * v + 0.5);
-    int i = (x + y * width_) * 3;
-    return { data_[i + 0], data_[i + 1], data_[i + 2] };
+    double u;
+    double v;
+    octahedralEncode(d, u, v);
+    return bilinear(levels_[0], u, v);
+}
+
+Vec3 HdriSky::sampleCone(const Vec3& d, double spread) const
+{
+    // Texels cover 4 pi / size^2 steradians on average, the level picked has texels about as wide as the cone
+    double lod = std::log2(spread * levels_[0].size / std::sqrt(4.0 * pi));
+
+    if (!(lod > 0.0))
+    {
+        return Sample(d);
+    }
+
+    double u;
+    double v;
+    octahedralEncode(d, u, v);
+    lod = std::min(lod, double(levels_.size() - 1));
+    size_t fine = size_t(lod);
+    double blend = lod - double(fine);
+
+    if (blend == 0.0)
+    {
+        return bilinear(levels_[fine], u, v);
+    }
+
+    return lerp(bilinear(levels_[fine], u, v), bilinear(levels_[fine + 1], u, v), blend);
+}
+
+Vec3 HdriSky::bilinear(const Level& level, double u, double v) const
+{
+    // Coordinates are at least -0.5, so truncating one past them floors
+    double x = u * level.size - 0.5;
+    double y = v * level.size - 0.5;
+    int x0 = int(x + 1.0) - 1;
+    int y0 = int(y + 1.0) - 1;
+    double fx = x - x0;
+    double fy = y - y0;
+
+    if (x0 < 0 || y0 < 0 || x0 + 1 >= level.size || y0 + 1 >= level.size)
+    {
+        return lerp(lerp(texel(level, x0, y0), texel(level, x0 + 1, y0), fx),
+                    lerp(texel(level, x0, y0 + 1), texel(level, x0 + 1, y0 + 1), fx), fy);
+    }
+
+    const uint32_t* row0 = &texels_[level.offset + x0 + size_t(y0) * level.size];
+    const uint32_t* row1 = row0 + level.size;
+    return fromRgbe(row0[0]) * ((1.0 - fx) * (1.0 - fy)) + fromRgbe(row0[1]) * (fx * (1.0 - fy)) +
+           fromRgbe(row1[0]) * ((1.0 - fx) * fy) + fromRgbe(row1[1]) * (fx * fy);
+}
+
+bool HdriSky::sampleDirection(Sampler& sampler, Vec3& d, double& pdf) const
+{
+    double u;
+    double v;
+    double uvPdf;
+    distribution_.sampleContinuous(sampler(), sampler(), u, v, uvPdf);
+
+    if (uvPdf <= 0)
+    {
+        return false;
+    }
+
+    d = octahedralDecode(u, v);
+    pdf = uvPdf / octahedralJacobian(d);
+    return true;
+}
+
+double HdriSky::pdf(const Vec3& d) const
+{
+    double u;
+    double v;
+    octahedralEncode(d, u, v);
+    return distribution_.pdf(u, v) / octahedralJacobian(normalize(d));
+}
+
+Vec3 HdriSky::texel(const Level& level, int x, int y) const
+{
+    if (x < 0 || x >= level.size)
+    {
+        x = (x < 0) ? 0 : level.size - 1;
+        y = level.size - 1 - y;
+    }
+
+    if (y < 0 || y >= level.size)
+    {
+        y = (y < 0) ? 0 : level.size - 1;
+        x = level.size - 1 - x;
+    }
+
+    return fromRgbe(texels_[level.offset + x + size_t(y) * level.size]);
 }
 
 GradientSky::GradientSky(Vec3 nadirColor, Vec3 zenithColor)
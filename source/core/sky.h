@@ -1,8 +1,13 @@
 #pragma once
 
+#include "core/distribution.h"
 #include "core/vec3.h"
 
+#include <cstdint>
 #include <string_view>
+#include <vector>
+
+class Sampler;
 
 class Sky
 {
@@ -10,20 +15,44 @@ public:
     virtual ~Sky() = default;
 
     virtual Vec3 Sample(const Vec3& d) const = 0;
+
+    // Sample() averaged over a cone of directions spread radians across, for rays that escape after widening. Skies
+    // without detail to lose just return Sample().
+    virtual Vec3 sampleCone(const Vec3& d, double spread) const { return Sample(d); }
+
+    // Direction sampling for direct lighting, skies that aren't worth importance sampling return false
+    virtual bool sampleDirection(Sampler& sampler, Vec3& d, double& pdf) const { return false; }
+    virtual double pdf(const Vec3& d) const { return 0.0; }
 };
 
+// Environment map, converted at load time from a latitude-longitude image to an octahedral map of shared exponent (RGBE)
+// texels, a third of the float image's size. Directions map onto the octahedron and unfold into the square without any
+// trigonometry, and lookups are filtered bilinearly across the map's folded edges. A mip chain of box filtered levels
+// serves wide ray cones.
 class HdriSky : public Sky
 {
 public:
-    ~HdriSky();
-
     bool load(std::string_view path);
     Vec3 Sample(const Vec3& d) const override;
+    Vec3 sampleCone(const Vec3& d, double spread) const override;
+
+    bool sampleDirection(Sampler& sampler, Vec3& d, double& pdf) const override;
+    double pdf(const Vec3& d) const override;
 
 private:
-    int width_;
-    int height_;
-    float* data_;
+    struct Level
+    {
+        int size;       // The level is size x size texels
+        size_t offset;  // Texels before the level's first one
+    };
+
+    // Texels past an edge of the map come from the other side of the fold, mirrored about the edge's midpoint
+    Vec3 texel(const Level& level, int x, int y) const;
+    Vec3 bilinear(const Level& level, double u, double v) const;
+
+    std::vector<Level> levels_;     // Level 0 is full resolution, each one after it is half the size of the last
+    std::vector<uint32_t> texels_;
+    Distribution2D distribution_;   // Over the map's square, coarser than the texels for large maps
 };
 
 class GradientSky : public Sky
@@ -0,0 +1,325 @@
+#include "path_guiding.h"
+
+#include "core/rtiow.h"
+
+#include <algorithm>
+#include <cmath>
+
+// Recorded values are scaled to integers so that sums are exact and independent of the order threads add them in
+constexpr double FixedPointScale = double(1 << 20);
+constexpr double MaxRecordedValue = 1e6;
+
+// Records above this many times the mean of the previous iteration are clamped. A few paths that found a bright
+// light through unlikely bounces would otherwise carve narrow spikes into the distribution that don't match the
+// radiance nearby and only get sampled by luck.
+constexpr double MaxRecordedToMean = 10.0;
+
+// Paths a spatial leaf must record in the first iteration before it's split, later iterations scale this by
+// sqrt(2^iteration) since they render twice as many samples each time
+constexpr double SpatialSplitThreshold = 4000.0;
+
+// Quadrants holding more than this fraction of a DTree's energy are subdivided
+constexpr double DirectionalSplitThreshold = 0.01;
+constexpr uint32_t MaxDirectionalDepth = 20;
+
+constexpr double OneMinusEpsilon = 0x1.fffffffffffffp-1;
+
+static Vec3 squareToDirection(double u0, double u1)
+{
+    double z = 2.0 * u0 - 1.0;
+    double r = std::sqrt(std::max(0.0, 1.0 - z * z));
+    double phi = 2.0 * pi * u1;
+    return Vec3(r * std::cos(phi), r * std::sin(phi), z);
+}
+
+static void directionToSquare(const Vec3& d, double& u0, double& u1)
+{
+    double phi = std::atan2(d.y, d.x) / (2.0 * pi);
+    u0 = std::clamp((d.z + 1.0) * 0.5, 0.0, OneMinusEpsilon);
+    u1 = std::clamp(phi < 0.0 ? phi + 1.0 : phi, 0.0, OneMinusEpsilon);
+}
+
+// Returns the quadrant containing (u0, u1) and rescales them to cover it
+static uint32_t quadrant(double& u0, double& u1)
+{
+    uint32_t ix = u0 < 0.5 ? 0 : 1;
+    uint32_t iy = u1 < 0.5 ? 0 : 1;
+    u0 = 2.0 * u0 - ix;
+    u1 = 2.0 * u1 - iy;
+    return ix + 2 * iy;
+}
+
+DTree::DTree()
+    : maxRecord_(MaxRecordedValue)
+{
+    startIteration(DirectionalSplitThreshold, MaxDirectionalDepth);
+}
+
+DTree::DTree(const DTree& other)
+    : sampling_(other.sampling_)
+    , samplingTotal_(other.samplingTotal_)
+    , maxRecord_(other.maxRecord_)
+    , recording_(other.recording_)
+    , recordedSums_(std::make_unique<std::atomic<uint64_t>[]>(other.recording_.size() * 4))
+    , sampleCount_(other.sampleCount_.load())
+{
+    for (size_t i = 0; i < recording_.size() * 4; ++i)
+    {
+        recordedSums_[i] = other.recordedSums_[i].load();
+    }
+}
+
+Vec3 DTree::sample(double u0, double u1, double& pdf) const
+{
+    double x = 0.0;
+    double y = 0.0;
+    double size = 1.0;
+    double density = 1.0;
+    uint32_t node = 0;
+
+    for (;;)
+    {
+        const Node& n = sampling_[node];
+        double total = n.sums[0] + n.sums[1] + n.sums[2] + n.sums[3];
+
+        // Pick the column, then the quadrant within it, reusing what's left of each random number
+        double left = n.sums[0] + n.sums[2];
+        double pLeft = left / total;
+        uint32_t ix = u0 < pLeft ? 0 : 1;
+        u0 = std::min(ix == 0 ? u0 / pLeft : (u0 - pLeft) / (1.0 - pLeft), OneMinusEpsilon);
+
+        double pBottom = n.sums[ix] / (ix == 0 ? left : total - left);
+        uint32_t iy = u1 < pBottom ? 0 : 1;
+        u1 = std::min(iy == 0 ? u1 / pBottom : (u1 - pBottom) / (1.0 - pBottom), OneMinusEpsilon);
+
+        uint32_t q = ix + 2 * iy;
+        density *= 4.0 * n.sums[q] / total;
+        size *= 0.5;
+        x += ix * size;
+        y += iy * size;
+
+        if (!n.children[q])
+        {
+            break;
+        }
+
+        node = n.children[q];
+    }
+
+    pdf = density / (4.0 * pi);
+    return squareToDirection(x + u0 * size, y + u1 * size);
+}
+
+double DTree::pdf(const Vec3& direction) const
+{
+    double u0;
+    double u1;
+    directionToSquare(direction, u0, u1);
+
+    double density = 1.0;
+    uint32_t node = 0;
+
+    for (;;)
+    {
+        const Node& n = sampling_[node];
+        uint32_t q = quadrant(u0, u1);
+        density *= 4.0 * n.sums[q] / (n.sums[0] + n.sums[1] + n.sums[2] + n.sums[3]);
+
+        if (!n.children[q] || density == 0.0)
+        {
+            break;
+        }
+
+        node = n.children[q];
+    }
+
+    return density / (4.0 * pi);
+}
+
+void DTree::record(const Vec3& direction, double radiance)
+{
+    if (radiance > 0.0)
+    {
+        double u0;
+        double u1;
+        directionToSquare(direction, u0, u1);
+
+        uint32_t node = 0;
+        uint32_t q = quadrant(u0, u1);
+
+        while (recording_[node].children[q])
+        {
+            node = recording_[node].children[q];
+            q = quadrant(u0, u1);
+        }
+
+        uint64_t value = uint64_t(std::min(radiance, maxRecord_) * FixedPointScale);
+        recordedSums_[node * 4 + q].fetch_add(value, std::memory_order_relaxed);
+    }
+
+    sampleCount_.fetch_add(1, std::memory_order_relaxed);
+}
+
+void DTree::finishIteration()
+{
+    sampling_ = recording_;
+
+    // Children always come after their parent, so a reverse sweep sees every child's sums before they're needed
+    for (size_t i = sampling_.size(); i-- > 0;)
+    {
+        Node& n = sampling_[i];
+
+        for (uint32_t q = 0; q < 4; ++q)
+        {
+            if (n.children[q])
+            {
+                const Node& child = sampling_[n.children[q]];
+                n.sums[q] = child.sums[0] + child.sums[1] + child.sums[2] + child.sums[3];
+            }
+            else
+            {
+                n.sums[q] = double(recordedSums_[i * 4 + q].load()) / FixedPointScale;
+            }
+        }
+    }
+
+    const Node& root = sampling_[0];
+    samplingTotal_ = root.sums[0] + root.sums[1] + root.sums[2] + root.sums[3];
+
+    if (samplingTotal_ > 0.0)
+    {
+        maxRecord_ = std::min(MaxRecordedToMean * samplingTotal_ / double(sampleCount_.load()), MaxRecordedValue);
+    }
+}
+
+void DTree::startIteration(double threshold, uint32_t maxDepth)
+{
+    constexpr uint32_t NoSource = UINT32_MAX;
+
+    // source is the matching node of the sampling tree, or NoSource below its leaves where the energy is split evenly
+    struct Item
+    {
+        uint32_t node;
+        uint32_t source;
+        double sum;
+        uint32_t depth;
+    };
+
+    recording_.assign(1, Node{});
+
+    if (samplingTotal_ > 0.0)
+    {
+        std::vector<Item> stack{ { 0, 0, samplingTotal_, 1 } };
+
+        while (!stack.empty())
+        {
+            Item item = stack.back();
+            stack.pop_back();
+
+            for (uint32_t q = 0; q < 4; ++q)
+            {
+                double sum = (item.source != NoSource) ? sampling_[item.source].sums[q] : item.sum * 0.25;
+
+                if (item.depth >= maxDepth || sum <= threshold * samplingTotal_)
+                {
+                    continue;
+                }
+
+                uint32_t child = uint32_t(recording_.size());
+                recording_.push_back(Node{});
+                recording_[item.node].children[q] = child;
+
+                uint32_t source = NoSource;
+
+                if (item.source != NoSource && sampling_[item.source].children[q])
+                {
+                    source = sampling_[item.source].children[q];
+                }
+
+                stack.push_back({ child, source, sum, item.depth + 1 });
+            }
+        }
+    }
+
+    recordedSums_ = std::make_unique<std::atomic<uint64_t>[]>(recording_.size() * 4);
+    sampleCount_ = 0;
+}
+
+SdTree::SdTree(const Aabb& bounds)
+{
+    // Use a cube, so splitting each axis in turn keeps the cells cubic
+    Vec3 extents = bounds.extents();
+    double size = std::max(extents.x, std::max(extents.y, extents.z));
+    origin_ = bounds.mins;
+    invSize_ = (size > 0.0) ? 1.0 / size : 1.0;
+
+    for (uint32_t i = 0; i < NumRoots; ++i)
+    {
+        nodes_.push_back(Node{ { 0, 0 }, i, 0 });
+        dTrees_.emplace_back();
+    }
+}
+
+DTree& SdTree::lookup(const Vec3& p, const Vec3& n)
+{
+    // Surfaces get a tree per dominant normal axis and sign, media get the last one
+    uint32_t axis = (std::abs(n.x) > std::abs(n.y)) ? 0 : 1;
+    axis = (std::abs(n[axis]) > std::abs(n.z)) ? axis : 2;
+    uint32_t node = (n == Vec3(0, 0, 0)) ? NumRoots - 1 : axis * 2 + (n[axis] < 0.0 ? 1 : 0);
+
+    Vec3 local = (p - origin_) * invSize_;
+    double u[3] = {
+        std::clamp(local.x, 0.0, OneMinusEpsilon),
+        std::clamp(local.y, 0.0, OneMinusEpsilon),
+        std::clamp(local.z, 0.0, OneMinusEpsilon),
+    };
+
+    while (nodes_[node].children[0])
+    {
+        uint32_t splitAxis = nodes_[node].axis;
+        uint32_t side = u[splitAxis] < 0.5 ? 0 : 1;
+        u[splitAxis] = 2.0 * u[splitAxis] - side;
+        node = nodes_[node].children[side];
+    }
+
+    return dTrees_[nodes_[node].dTree];
+}
+
+void SdTree::refine(uint32_t iteration)
+{
+    for (DTree& dTree : dTrees_)
+    {
+        dTree.finishIteration();
+    }
+
+    uint64_t threshold = uint64_t(SpatialSplitThreshold * std::pow(2.0, 0.5 * iteration));
+
+    // New leaves are appended, so they get split again in the same sweep if they're still over the threshold
+    for (size_t i = 0; i < nodes_.size(); ++i)
+    {
+        uint32_t dTree = nodes_[i].dTree;
+        uint64_t count = dTrees_[dTree].sampleCount();
+
+        if (nodes_[i].children[0] || count <= threshold)
+        {
+            continue;
+        }
+
+        // Both halves start out with the parent's distribution and are assumed to have seen half of its paths
+        dTrees_[dTree].setSampleCount(count / 2);
+        DTree copy(dTrees_[dTree]);
+        dTrees_.push_back(copy);
+
+        uint32_t axis = (nodes_[i].axis + 1) % 3;
+        uint32_t first = uint32_t(nodes_.size());
+        nodes_.push_back(Node{ { 0, 0 }, dTree, axis });
+        nodes_.push_back(Node{ { 0, 0 }, uint32_t(dTrees_.size() - 1), axis });
+        nodes_[i].children[0] = first;
+        nodes_[i].children[1] = first + 1;
+    }
+
+    for (DTree& dTree : dTrees_)
+    {
+        dTree.startIteration(DirectionalSplitThreshold, MaxDirectionalDepth);
+    }
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include "core/aabb.h"
+#include "core/vec3.h"
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// Incident radiance at one region of space, learnt as a quadtree over the square [0, 1]^2 mapped to the sphere with
+// the cylindrical (equal area) mapping. Sampling uses what was recorded during the previous training iteration, the
+// current iteration records into a separate tree refined from it. (Müller et al. 2017, "Practical Path Guiding for
+// Efficient Light-Transport Simulation")
+class DTree
+{
+public:
+    DTree();
+    DTree(const DTree& other);
+
+    DTree& operator=(const DTree&) = delete;
+
+    bool trained() const { return samplingTotal_ > 0; }
+
+    // Only valid once trained()
+    Vec3 sample(double u0, double u1, double& pdf) const;
+    double pdf(const Vec3& direction) const;
+
+    // Thread safe, radiance is an estimate of the incident radiance along direction divided by its sampling pdf
+    void record(const Vec3& direction, double radiance);
+
+    uint64_t sampleCount() const { return sampleCount_; }
+    void setSampleCount(uint64_t count) { sampleCount_ = count; }
+
+    // Makes the recorded distribution the sampling distribution
+    void finishIteration();
+
+    // Builds an empty recording tree, subdividing quadrants holding more than threshold of the sampled energy
+    void startIteration(double threshold, uint32_t maxDepth);
+
+private:
+    struct Node
+    {
+        uint32_t children[4];   // Zero for leaf quadrants, quadrant index is x + 2 * y
+        double sums[4];
+    };
+
+    std::vector<Node> sampling_;
+    double samplingTotal_{ 0.0 };
+    double maxRecord_;      // Records are clamped to this, a multiple of the mean record of the last iteration
+
+    std::vector<Node> recording_;
+    std::unique_ptr<std::atomic<uint64_t>[]> recordedSums_;     // Fixed point, so totals don't depend on thread timing
+    std::atomic<uint64_t> sampleCount_{ 0 };
+};
+
+// Binary trees over the scene bounds with a DTree in each leaf. Leaves that recorded many paths are split after each
+// training iteration.
+class SdTree
+{
+public:
+    explicit SdTree(const Aabb& bounds);
+
+    // n is the surface normal, or zero for scattering inside a medium
+    DTree& lookup(const Vec3& p, const Vec3& n);
+
+    // Call between training iterations, iteration counts from zero and its length should double each time
+    void refine(uint32_t iteration);
+
+private:
+    // Separate roots for surfaces facing along each of +-x, +-y and +-z and one for media, so a leaf never mixes
+    // points whose incident radiance lies in opposite hemispheres
+    static constexpr uint32_t NumRoots = 7;
+
+    struct Node
+    {
+        uint32_t children[2];   // Zero for leaves
+        uint32_t dTree;
+        uint32_t axis;
+    };
+
+    Vec3 origin_;
+    double invSize_;
+    std::vector<Node> nodes_;
+    std::vector<DTree> dTrees_;
+};
@@ -0,0 +1,403 @@
+#include "path_integrator.h"
+
+#include "core/hit_record.h"
+#include "core/sampler.h"
+#include "core/sampling.h"
+#include "integrators/path_guiding.h"
+#include "integrators/photon_map.h"
+#include "integrators/radiance_cache.h"
+#include "materials/material.h"
+#include "scenes/scene.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+// Never survive roulette with certainty, otherwise paths that keep full throughput (e.g. bouncing around inside clear
+// glass) would only ever be terminated by the depth limits.
+constexpr double MaxSurvivalProbability = 0.95;
+
+// Probability of sampling the guide rather than the BSDF at guided vertices. The guide only learns incident radiance,
+// so the BSDF's cosine and lobe shape still make it the better strategy for most of the samples.
+constexpr double GuideSamplingFraction = 0.25;
+
+// Vertices past this depth aren't recorded into the guide or the cache, they carry little of the training signal
+constexpr uint32_t MaxRecordedVertices = 32;
+
+struct GuideVertex
+{
+    DTree* dTree;
+    Vec3 wi;
+    Vec3 throughput;    // Including the scattering at this vertex
+    Vec3 radiance;      // Radiance accumulated by the path before it left this vertex
+    double pdf;
+};
+
+struct CacheVertex
+{
+    Vec3 p;
+    Vec3 n;
+    Vec3 albedo;
+    Vec3 throughput;    // Up to this vertex
+    Vec3 radiance;      // Radiance accumulated by the path before it reached this vertex's light sampling
+};
+
+PathIntegrator::PathIntegrator(const CreateInfo& createInfo)
+    : info_(createInfo)
+{
+}
+
+void PathIntegrator::setGuide(std::shared_ptr<SdTree> guide, bool training)
+{
+    guide_ = std::move(guide);
+    training_ = training;
+}
+
+void PathIntegrator::setPhotonMap(std::shared_ptr<const PhotonMap> photonMap)
+{
+    photonMap_ = std::move(photonMap);
+}
+
+void PathIntegrator::setRadianceCache(std::shared_ptr<RadianceCache> cache, bool recording)
+{
+    cache_ = std::move(cache);
+    recordingCache_ = recording;
+}
+
+Vec3 PathIntegrator::radiance(const Ray& r, const Scene& scene, Sampler& sampler) const
+{
+    HitRecord hit{};
+
+    sampler.startDimension(0, Sampler::Dimension::Medium);
+
+    bool found = scene.hit(r, 0.001, std::numeric_limits<double>::infinity(), hit);
+    return radiance(r, found ? &hit : nullptr, scene, sampler);
+}
+
+Vec3 PathIntegrator::radiance(const Ray& r, const HitRecord* firstHit, const Scene& scene, Sampler& sampler) const
+{
+    if (!firstHit)
+    {
+        return tracePath(r, nullptr, scene, sampler);
+    }
+
+    // Continuing several paths from the camera ray's hit spreads the cost of generating and tracing it over more of
+    // the indirect light. Paths leaving a glossy surface mostly go the same way and a delta one always does, so the
+    // number continued shrinks with the width of the material's lobe.
+    uint32_t maxSplits = std::max(info_.primarySplits, 1u);
+    double spread = r.primary ? firstHit->material->scatterSpread() : 0.0;
+    uint32_t numSplits = 1 + uint32_t(std::lround((maxSplits - 1) * spread));
+
+    if (numSplits == 1)
+    {
+        return tracePath(r, firstHit, scene, sampler);
+    }
+
+    Vec3 radiance{};
+
+    for (uint32_t split = 0; split < numSplits; ++split)
+    {
+        // Always strided by maxSplits, so camera rays continued fewer times don't reuse another's sample indices
+        sampler.startSplit(split, maxSplits);
+        radiance += tracePath(r, firstHit, scene, sampler);
+    }
+
+    return radiance / double(numSplits);
+}
+
+Vec3 PathIntegrator::tracePath(const Ray& r, const HitRecord* firstHit, const Scene& scene, Sampler& sampler) const
+{
+    Vec3 radiance{};
+    Vec3 throughput{ 1, 1, 1 };
+    Ray ray = r;
+    uint32_t bounces[3] = {};
+    const uint32_t maxBounces[3] = { info_.maxDiffuseDepth, info_.maxSpecularDepth, info_.maxVolumeDepth };
+    bool lightSampling = info_.lightSampling && !scene.lights.empty();
+
+    // Emitters found by a non-delta bounce were also light sampled at the previous vertex
+    bool specularBounce = true;
+    double lastPdf = 0.0;
+    bool diffuseBounce = false;
+
+    // Set while the path hasn't left the last diffuse surface that gathered caustics from the photon map, other than
+    // through delta bounces. Emitters found in that state were already counted by the photon map.
+    bool causticsGathered = false;
+
+    GuideVertex vertices[MaxRecordedVertices];
+    uint32_t numVertices = 0;
+    CacheVertex cacheVertices[MaxRecordedVertices];
+    uint32_t numCacheVertices = 0;
+
+    HitRecord hit = firstHit ? *firstHit : HitRecord{};
+    bool found = (firstHit != nullptr);
+
+    for (uint32_t depth = 0; depth < info_.maxDepth; ++depth)
+    {
+        if (depth > 0)
+        {
+            hit = HitRecord{};
+            sampler.startDimension(depth, Sampler::Dimension::Medium);
+            found = scene.hit(ray, 0.001, std::numeric_limits<double>::infinity(), hit);
+        }
+
+        if (!found)
+        {
+            double weight = 1.0;
+
+            if (info_.lightSampling && !specularBounce)
+            {
+                weight = powerHeuristic(lastPdf, scene.sky->pdf(ray.direction));
+            }
+
+            // Only seen through delta bounces is the sky filtered, anything else is weighed against sky samples and
+            // spreading it over a wide cone would move light between directions the surface weighs differently
+            double spread = specularBounce ? ray.coneSpread : 0.0;
+            radiance += throughput * scene.sky->sampleCone(ray.direction, spread) * weight;
+            break;
+        }
+
+        // Texture lookups depend on the footprint, so the albedo is only looked up (once, by the material) after it's set
+        hit.footprint = ray.footprint(hit.t);
+
+        Vec3 emitted = hit.material->emitted(hit);
+
+        if (emitted != Vec3(0, 0, 0) && !(specularBounce && causticsGathered))
+        {
+            double weight = 1.0;
+
+            if (lightSampling && !specularBounce)
+            {
+                weight = powerHeuristic(lastPdf, scene.lights.pdfValue(ray.origin, ray.direction, ray.time));
+            }
+
+            radiance += throughput * emitted * weight;
+        }
+
+        BsdfSample bsdf;
+
+        sampler.startDimension(depth, Sampler::Dimension::Bsdf);
+
+        if (!hit.material->sample(sampler, hit, -ray.direction, bsdf))
+        {
+            break;
+        }
+
+        if (++bounces[int(bsdf.type)] > maxBounces[int(bsdf.type)])
+        {
+            break;
+        }
+
+        if (!bsdf.delta)
+        {
+            causticsGathered = photonMap_ && bsdf.type == ScatterType::Diffuse;
+
+            if (causticsGathered)
+            {
+                radiance += throughput * photonMap_->estimate(hit, -ray.direction, sampler.pixelSampleIndex());
+            }
+        }
+
+        // Once a path has bounced off a diffuse surface, blurring what it finds there can't be seen, so the cached light
+        // leaving the next diffuse surface replaces tracing the rest of the path
+        if (cache_ && !recordingCache_ && diffuseBounce && bsdf.type == ScatterType::Diffuse)
+        {
+            sampler.startDimension(depth, Sampler::Dimension::Cache);
+            Vec3 jitter{ sampler(), sampler(), sampler() };
+            Vec3 cached;
+
+            if (cache_->lookup(hit.p, hit.n, hit.material->albedo(hit), jitter, cached))
+            {
+                radiance += throughput * cached;
+                break;
+            }
+        }
+
+        if (cache_ && recordingCache_ && bsdf.type == ScatterType::Diffuse && numCacheVertices < MaxRecordedVertices)
+        {
+            cacheVertices[numCacheVertices++] = { hit.p, hit.n, hit.material->albedo(hit), throughput, radiance };
+        }
+
+        specularBounce = bsdf.delta;
+        diffuseBounce = (bsdf.type == ScatterType::Diffuse);
+        DTree* dTree = nullptr;
+
+        if (guide_ && !bsdf.delta)
+        {
+            dTree = &guide_->lookup(hit.p, (bsdf.type == ScatterType::Volume) ? Vec3(0, 0, 0) : hit.n);
+        }
+
+        const DTree* guideDTree = (dTree && dTree->trained()) ? dTree : nullptr;
+
+        if (guideDTree)
+        {
+            // The BSDF's point is drawn again and split between the guide and a fresh BSDF sample, so that the
+            // directions of both stay stratified. The first BSDF sample only told whether this vertex can be guided.
+            sampler.startDimension(depth, Sampler::Dimension::Bsdf);
+
+            if (sampler.choose(GuideSamplingFraction))
+            {
+                double u0 = sampler();
+                double u1 = sampler();
+                double guidePdf;
+                bsdf.wi = guideDTree->sample(u0, u1, guidePdf);
+                bsdf.f = hit.material->eval(hit, -ray.direction, bsdf.wi);
+            }
+            else if (!hit.material->sample(sampler, hit, -ray.direction, bsdf))
+            {
+                break;
+            }
+
+            bsdf.pdf = scatterPdf(hit, -ray.direction, bsdf.wi, guideDTree);
+        }
+
+        if (info_.lightSampling && !specularBounce && depth + 1 < info_.maxDepth)
+        {
+            if (lightSampling)
+            {
+                sampler.startDimension(depth, Sampler::Dimension::Light);
+                radiance += throughput * sampleLights(ray, hit, scene, guideDTree, sampler);
+            }
+
+            sampler.startDimension(depth, Sampler::Dimension::Sky);
+            radiance += throughput * sampleSky(ray, hit, scene, guideDTree, sampler);
+        }
+
+        // Guided directions can point into the surface, the path ends there but light sampling above still counts
+        if (bsdf.pdf <= 0.0 || bsdf.f == Vec3(0, 0, 0))
+        {
+            break;
+        }
+
+        lastPdf = bsdf.pdf;
+        throughput *= bsdf.f / bsdf.pdf;
+
+        if (training_ && dTree && numVertices < MaxRecordedVertices)
+        {
+            vertices[numVertices++] = { dTree, bsdf.wi, throughput, radiance, bsdf.pdf };
+        }
+
+        if (depth + 1 >= info_.rouletteDepth)
+        {
+            double survival = std::min(std::max(throughput.x, std::max(throughput.y, throughput.z)), MaxSurvivalProbability);
+
+            sampler.startDimension(depth, Sampler::Dimension::Roulette);
+
+            if (sampler() >= survival)
+            {
+                break;
+            }
+
+            throughput /= survival;
+        }
+
+        double coneSpread = scatteredConeSpread(ray.coneSpread, bsdf);
+        ray = Ray(hit.p, bsdf.wi, ray.time, false, ray.sampler);
+        ray.coneWidth = hit.footprint;
+        ray.coneSpread = coneSpread;
+    }
+
+    // Whatever the path gathered after leaving a vertex, divided by the throughput up to there, estimates the radiance
+    // arriving at it along wi
+    for (uint32_t i = 0; i < numVertices; ++i)
+    {
+        const GuideVertex& v = vertices[i];
+        Vec3 gathered = radiance - v.radiance;
+        double incident = 0.0;
+
+        for (int c = 0; c < 3; ++c)
+        {
+            incident += (v.throughput[c] > 0.0) ? gathered[c] / v.throughput[c] : 0.0;
+        }
+
+        v.dTree->record(v.wi, incident / (3.0 * v.pdf));
+    }
+
+    for (uint32_t i = 0; i < numCacheVertices; ++i)
+    {
+        const CacheVertex& v = cacheVertices[i];
+        cache_->record(v.p, v.n, radiance - v.radiance, v.throughput * v.albedo);
+    }
+
+    return radiance;
+}
+
+double PathIntegrator::scatterPdf(const HitRecord& hit, const Vec3& wo, const Vec3& wi, const DTree* dTree) const
+{
+    double bsdfPdf = hit.material->pdf(hit, wo, wi);
+
+    if (!dTree)
+    {
+        return bsdfPdf;
+    }
+
+    return GuideSamplingFraction * dTree->pdf(wi) + (1.0 - GuideSamplingFraction) * bsdfPdf;
+}
+
+Vec3 PathIntegrator::sampleLights(const Ray& r, const HitRecord& hit, const Scene& scene, const DTree* dTree, Sampler& sampler) const
+{
+    Vec3 direction = scene.lights.sampleDirection(sampler, hit.p, r.time);
+    Vec3 f = hit.material->eval(hit, -r.direction, direction);
+
+    if (f == Vec3(0, 0, 0))
+    {
+        return Vec3(0, 0, 0);
+    }
+
+    double lightPdf = scene.lights.pdfValue(hit.p, direction, r.time);
+
+    if (lightPdf <= 0)
+    {
+        return Vec3(0, 0, 0);
+    }
+
+    // Whatever surface the shadow ray reaches first is what's seen in that direction, blockers simply don't emit. Media
+    // on the way attenuate it.
+    Ray shadowRay(hit.p, direction, r.time, false, r.sampler, true);
+    HitRecord shadowHit{};
+
+    if (!scene.hit(shadowRay, 0.001, std::numeric_limits<double>::infinity(), shadowHit))
+    {
+        return Vec3(0, 0, 0);
+    }
+
+    Vec3 emitted = shadowHit.material->emitted(shadowHit);
+
+    if (emitted == Vec3(0, 0, 0))
+    {
+        return Vec3(0, 0, 0);
+    }
+
+    double transmittance = scene.transmittance(shadowRay, 0.001, shadowHit.t);
+    double weight = powerHeuristic(lightPdf, scatterPdf(hit, -r.direction, direction, dTree));
+    return f * emitted * (weight / lightPdf) * transmittance;
+}
+
+Vec3 PathIntegrator::sampleSky(const Ray& r, const HitRecord& hit, const Scene& scene, const DTree* dTree, Sampler& sampler) const
+{
+    Vec3 direction;
+    double skyPdf;
+
+    if (!scene.sky->sampleDirection(sampler, direction, skyPdf))
+    {
+        return Vec3(0, 0, 0);
+    }
+
+    Vec3 f = hit.material->eval(hit, -r.direction, direction);
+
+    if (f == Vec3(0, 0, 0))
+    {
+        return Vec3(0, 0, 0);
+    }
+
+    Ray shadowRay(hit.p, direction, r.time, false, r.sampler, true);
+    HitRecord shadowHit{};
+
+    if (scene.hit(shadowRay, 0.001, std::numeric_limits<double>::infinity(), shadowHit))
+    {
+        return Vec3(0, 0, 0);
+    }
+
+    double transmittance = scene.transmittance(shadowRay, 0.001, std::numeric_limits<double>::infinity());
+    double weight = powerHeuristic(skyPdf, scatterPdf(hit, -r.direction, direction, dTree));
+    return f * scene.sky->Sample(direction) * (weight / skyPdf) * transmittance;
+}
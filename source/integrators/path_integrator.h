@@ -0,0 +1,66 @@
+#pragma once
+
+#include "core/ray.h"
+#include "core/vec3.h"
+
+#include <cstdint>
+#include <memory>
+
+class DTree;
+class PhotonMap;
+class RadianceCache;
+class Scene;
+class SdTree;
+struct HitRecord;
+class Sampler;
+
+class PathIntegrator
+{
+public:
+    struct CreateInfo
+    {
+        uint32_t maxDepth;
+        uint32_t maxDiffuseDepth;
+        uint32_t maxSpecularDepth;
+        uint32_t maxVolumeDepth;
+        uint32_t rouletteDepth;     // Bounces before Russian roulette kicks in
+        bool lightSampling;         // Next event estimation against Scene::lights and the sky
+        uint32_t primarySplits;     // Most paths continued from each camera ray's hit, scaled by its material's scatterSpread()
+    };
+
+    PathIntegrator(const CreateInfo& createInfo);
+
+    Vec3 radiance(const Ray& r, const Scene& scene, Sampler& sampler) const;
+
+    // For a camera ray whose first intersection is already known, firstHit is null if r escaped
+    Vec3 radiance(const Ray& r, const HitRecord* firstHit, const Scene& scene, Sampler& sampler) const;
+
+    // Mixes sampling of the guide's learnt incident radiance into every non-delta bounce. While training, paths also
+    // record what they find into it.
+    void setGuide(std::shared_ptr<SdTree> guide, bool training);
+
+    // Caustics at diffuse surfaces come from the photons of the pixel sample's pass, paths no longer count the light
+    // they find through delta bounces after one
+    void setPhotonMap(std::shared_ptr<const PhotonMap> photonMap);
+
+    // While recording, paths add the light leaving the diffuse surfaces they hit to the cache. Otherwise paths stop at
+    // the first diffuse surface after a diffuse bounce and take its light from the cache.
+    void setRadianceCache(std::shared_ptr<RadianceCache> cache, bool recording);
+
+private:
+    // Traces a path from r, whose first intersection has already been found. firstHit is null if r escaped.
+    Vec3 tracePath(const Ray& r, const HitRecord* firstHit, const Scene& scene, Sampler& sampler) const;
+
+    Vec3 sampleLights(const Ray& r, const HitRecord& hit, const Scene& scene, const DTree* dTree, Sampler& sampler) const;
+    Vec3 sampleSky(const Ray& r, const HitRecord& hit, const Scene& scene, const DTree* dTree, Sampler& sampler) const;
+
+    // Solid angle pdf of the next direction, with dTree null when guiding isn't used at this vertex
+    double scatterPdf(const HitRecord& hit, const Vec3& wo, const Vec3& wi, const DTree* dTree) const;
+
+    CreateInfo info_;
+    std::shared_ptr<SdTree> guide_;
+    bool training_{ false };
+    std::shared_ptr<const PhotonMap> photonMap_;
+    std::shared_ptr<RadianceCache> cache_;
+    bool recordingCache_{ false };
+};
@@ -0,0 +1,247 @@
+#include "photon_map.h"
+
+#include "core/hit_record.h"
+#include "core/rng.h"
+#include "core/sampler.h"
+#include "core/sampling.h"
+#include "materials/material.h"
+#include "scenes/scene.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <limits>
+#include <thread>
+
+// Controls how quickly the gather radius shrinks, smaller values shrink it faster but leave more noise
+constexpr double RadiusAlpha = 2.0 / 3.0;
+
+// Photons further than this fraction of the radius from the surface's tangent plane belong to a different surface
+constexpr double DiskThickness = 0.1;
+
+// Photon paths are seeded as pixels of a row that no image has, so they're independent of the camera paths
+constexpr uint32_t PhotonRow = UINT32_MAX;
+
+// Photons are traced in chunks of this many, each chunk filling its own list so the order doesn't depend on threads
+constexpr uint32_t PhotonsPerChunk = 4096;
+
+PhotonMap::PhotonMap(const CreateInfo& createInfo)
+    : info_(createInfo)
+{
+}
+
+uint64_t PhotonMap::slot(const Pass& pass, int64_t x, int64_t y, int64_t z)
+{
+    return mixBits(uint64_t(x) ^ (uint64_t(y) << 21) ^ (uint64_t(z) << 42)) & pass.mask;
+}
+
+void PhotonMap::build(const Scene& scene, uint32_t firstPass, uint32_t numPasses, uint32_t numJobs)
+{
+    firstPass_ = firstPass;
+    passes_.clear();
+    passes_.resize(numPasses);
+
+    uint32_t chunksPerPass = (info_.numPhotons + PhotonsPerChunk - 1) / PhotonsPerChunk;
+    std::vector<std::vector<Photon>> chunks(size_t(chunksPerPass) * numPasses);
+    std::atomic<uint32_t> nextChunk{ 0 };
+    std::atomic<uint32_t> nextPass{ 0 };
+    std::vector<std::thread> threads;
+
+    for (uint32_t i = 0; i < std::max(numJobs, 1u); ++i)
+    {
+        threads.emplace_back([&]()
+        {
+            for (uint32_t chunk = nextChunk++; chunk < chunks.size(); chunk = nextChunk++)
+            {
+                uint32_t first = (chunk % chunksPerPass) * PhotonsPerChunk;
+                uint32_t last = std::min(first + PhotonsPerChunk, info_.numPhotons);
+                trace(scene, firstPass + chunk / chunksPerPass, first, last, chunks[chunk]);
+            }
+        });
+    }
+
+    for (std::thread& thread : threads)
+    {
+        thread.join();
+    }
+
+    threads.clear();
+
+    for (uint32_t i = 0; i < std::max(numJobs, 1u); ++i)
+    {
+        threads.emplace_back([&]()
+        {
+            for (uint32_t index = nextPass++; index < numPasses; index = nextPass++)
+            {
+                Pass& pass = passes_[index];
+
+                for (uint32_t chunk = 0; chunk < chunksPerPass; ++chunk)
+                {
+                    std::vector<Photon>& photons = chunks[size_t(index) * chunksPerPass + chunk];
+                    pass.photons.insert(pass.photons.end(), photons.begin(), photons.end());
+                    photons = std::vector<Photon>();
+                }
+
+                finish(pass, firstPass + index);
+            }
+        });
+    }
+
+    for (std::thread& thread : threads)
+    {
+        thread.join();
+    }
+}
+
+void PhotonMap::trace(const Scene& scene, uint32_t pass, uint32_t first, uint32_t last, std::vector<Photon>& photons) const
+{
+    RandomSampler sampler(info_.seed);
+    double timeBegin = scene.cameraCreateInfo.timeBegin;
+    double timeEnd = scene.cameraCreateInfo.timeEnd;
+
+    for (uint32_t i = first; i < last && !scene.lights.empty(); ++i)
+    {
+        sampler.startPixelSample(i, PhotonRow, pass);
+
+        HitRecord light{};
+        double time = sampler(timeBegin, timeEnd);
+        double inversePdf = scene.lights.samplePoint(sampler, time, light);
+        Vec3 emitted = (inversePdf > 0.0) ? light.material->emitted(light) : Vec3(0, 0, 0);
+
+        if (emitted == Vec3(0, 0, 0))
+        {
+            continue;
+        }
+
+        // Cosine weighted emission, so the power is just radiance times projected area
+        Vec3 power = emitted * (pi * inversePdf / info_.numPhotons);
+        Ray ray(light.p, localToWorld(light.n, squareToCosineHemisphere(sampler(), sampler())), time, false, &sampler);
+        bool caustic = false;
+
+        for (uint32_t depth = 0; depth <= info_.maxDepth; ++depth)
+        {
+            HitRecord hit{};
+
+            if (!scene.hit(ray, 0.001, std::numeric_limits<double>::infinity(), hit))
+            {
+                break;
+            }
+
+            BsdfSample bsdf;
+
+            if (!hit.material->sample(sampler, hit, -ray.direction, bsdf))
+            {
+                break;
+            }
+
+            if (!bsdf.delta)
+            {
+                // Light that reaches a diffuse surface without passing through a delta bounce is left to the path tracer
+                if (caustic && bsdf.type == ScatterType::Diffuse)
+                {
+                    photons.push_back({ hit.p, -ray.direction, power });
+                }
+
+                break;
+            }
+
+            caustic = true;
+            power *= bsdf.f / bsdf.pdf;
+            ray = Ray(hit.p, bsdf.wi, ray.time, false, ray.sampler);
+        }
+    }
+}
+
+void PhotonMap::finish(Pass& pass, uint32_t index) const
+{
+    double radiusSquared = info_.radius * info_.radius;
+
+    for (uint32_t i = 1; i <= index; ++i)
+    {
+        radiusSquared *= (i + RadiusAlpha) / (i + 1);
+    }
+
+    pass.radius = std::sqrt(radiusSquared);
+    pass.invCellSize = 0.5 / pass.radius;
+
+    // Counting sort of the photons by table slot
+    uint32_t bits = 0;
+
+    while ((size_t(1) << bits) < pass.photons.size() * 2)
+    {
+        ++bits;
+    }
+
+    pass.mask = (uint64_t(1) << bits) - 1;
+    pass.slotStarts.assign(pass.mask + 2, 0);
+    std::vector<uint64_t> slots(pass.photons.size());
+
+    for (size_t i = 0; i < pass.photons.size(); ++i)
+    {
+        Vec3 cell = floor(pass.photons[i].p * pass.invCellSize);
+        slots[i] = slot(pass, int64_t(cell.x), int64_t(cell.y), int64_t(cell.z));
+        ++pass.slotStarts[slots[i] + 1];
+    }
+
+    for (size_t i = 1; i < pass.slotStarts.size(); ++i)
+    {
+        pass.slotStarts[i] += pass.slotStarts[i - 1];
+    }
+
+    std::vector<Photon> sorted(pass.photons.size());
+    std::vector<uint32_t> next(pass.slotStarts.begin(), pass.slotStarts.end() - 1);
+
+    for (size_t i = 0; i < pass.photons.size(); ++i)
+    {
+        sorted[next[slots[i]]++] = pass.photons[i];
+    }
+
+    pass.photons = std::move(sorted);
+}
+
+Vec3 PhotonMap::estimate(const HitRecord& hit, const Vec3& wo, uint32_t pass) const
+{
+    const Pass& p = passes_[pass - firstPass_];
+
+    if (p.photons.empty())
+    {
+        return Vec3(0, 0, 0);
+    }
+
+    // Cells are twice the radius wide, so the gather disk overlaps at most two along each axis. Distinct cells can hash
+    // to the same slot, which must only be visited once.
+    Vec3 first = floor((hit.p - Vec3(p.radius, p.radius, p.radius)) * p.invCellSize);
+    uint64_t visited[8];
+    uint32_t numVisited = 0;
+    Vec3 sum{};
+    double radiusSquared = p.radius * p.radius;
+
+    for (int i = 0; i < 8; ++i)
+    {
+        uint64_t s = slot(p, int64_t(first.x) + (i & 1), int64_t(first.y) + ((i >> 1) & 1), int64_t(first.z) + (i >> 2));
+
+        if (std::find(visited, visited + numVisited, s) != visited + numVisited)
+        {
+            continue;
+        }
+
+        visited[numVisited++] = s;
+
+        for (uint32_t j = p.slotStarts[s]; j < p.slotStarts[s + 1]; ++j)
+        {
+            const Photon& photon = p.photons[j];
+            Vec3 d = photon.p - hit.p;
+            double cosine = dot(photon.wi, hit.n);
+
+            if (length2(d) > radiusSquared || std::abs(dot(d, hit.n)) > DiskThickness * p.radius || cosine <= 0.0)
+            {
+                continue;
+            }
+
+            // eval() includes the cosine, which the photon's power already accounts for
+            sum += hit.material->eval(hit, wo, photon.wi) * photon.power / cosine;
+        }
+    }
+
+    return sum / (pi * radiusSquared);
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include "core/vec3.h"
+
+#include <cstdint>
+#include <vector>
+
+class Scene;
+struct HitRecord;
+
+// Caustic photon map. Photons are traced from the scene's lights through delta (glass and mirror) surfaces only and
+// stored where they land on a diffuse surface, found again through a hashed grid whose cells are as wide as the gather
+// disk. Every pass gets its own set of photons and a smaller gather radius, so averaging the estimates of successive
+// passes converges like progressive photon mapping (Knaus and Zwicker 2011, "Progressive Photon Mapping: A
+// Probabilistic Approach").
+class PhotonMap
+{
+public:
+    struct CreateInfo
+    {
+        uint32_t numPhotons;    // Emitted per pass
+        double radius;          // Gather radius of the first pass
+        uint32_t maxDepth;      // Delta bounces a photon may take before it lands
+        uint32_t seed;
+    };
+
+    PhotonMap(const CreateInfo& createInfo);
+
+    // Replaces the photons with the sets of passes firstPass up to firstPass + numPasses, traced by numJobs threads
+    void build(const Scene& scene, uint32_t firstPass, uint32_t numPasses, uint32_t numJobs);
+
+    // Caustic light reflected from a diffuse surface towards wo, from the photons of pass, which must have been built
+    Vec3 estimate(const HitRecord& hit, const Vec3& wo, uint32_t pass) const;
+
+private:
+    struct Photon
+    {
+        Vec3 p;
+        Vec3 wi;        // Towards where the photon came from
+        Vec3 power;
+    };
+
+    struct Pass
+    {
+        double radius;
+        double invCellSize;
+        uint64_t mask{ 0 };
+        std::vector<Photon> photons;
+        std::vector<uint32_t> slotStarts;   // Table slot i holds photons[slotStarts[i]] up to photons[slotStarts[i + 1]]
+    };
+
+    static uint64_t slot(const Pass& pass, int64_t x, int64_t y, int64_t z);
+
+    // Traces photons first up to last of pass into photons
+    void trace(const Scene& scene, uint32_t pass, uint32_t first, uint32_t last, std::vector<Photon>& photons) const;
+
+    // Sets the radius of pass and sorts its photons into the table
+    void finish(Pass& pass, uint32_t index) const;
+
+    CreateInfo info_;
+    uint32_t firstPass_{ 0 };
+    std::vector<Pass> passes_;
+};
@@ -0,0 +1,134 @@
+#include "radiance_cache.h"
+
+#include "core/rng.h"
+
+#include <algorithm>
+#include <cmath>
+
+// Recorded values are scaled to integers so that sums are exact and independent of the order threads add them in
+constexpr double FixedPointScale = double(1 << 20);
+constexpr double MaxRecordedValue = 1e4;
+
+// Cells with fewer records than this are too noisy to replace tracing the rest of the path
+constexpr uint32_t MinRecords = 8;
+
+// Table slots are tried in order from the key's hash, a cell that can't be found in this many is dropped
+constexpr uint32_t MaxProbes = 32;
+
+constexpr uint32_t MaxTableBits = 22;
+constexpr int64_t MaxCellCoordinate = (1 << 20) - 1;
+
+RadianceCache::RadianceCache(const Aabb& bounds, uint32_t resolution)
+{
+    Vec3 extents = bounds.extents();
+    double size = std::max(extents.x, std::max(extents.y, extents.z));
+    resolution = std::max(resolution, 1u);
+    cellSize_ = (size > 0.0) ? size / resolution : 1.0;
+    invCellSize_ = 1.0 / cellSize_;
+    origin_ = bounds.mins;
+
+    // Surfaces cover roughly resolution^2 cells per face of the bounds, leave room so probe sequences stay short
+    uint32_t bits = 10;
+
+    while (bits < MaxTableBits && (uint64_t(1) << bits) < uint64_t(resolution) * resolution * 16)
+    {
+        ++bits;
+    }
+
+    mask_ = (uint64_t(1) << bits) - 1;
+    cells_ = std::make_unique<Cell[]>(mask_ + 1);
+}
+
+uint64_t RadianceCache::key(const Vec3& p, const Vec3& n) const
+{
+    uint32_t axis = (std::abs(n.x) > std::abs(n.y)) ? 0 : 1;
+    axis = (std::abs(n[axis]) > std::abs(n.z)) ? axis : 2;
+    uint64_t normal = axis * 2 + (n[axis] < 0.0 ? 1 : 0);
+
+    Vec3 cell = (p - origin_) * invCellSize_;
+    uint64_t x = uint64_t(std::clamp(int64_t(std::floor(cell.x)), int64_t(0), MaxCellCoordinate));
+    uint64_t y = uint64_t(std::clamp(int64_t(std::floor(cell.y)), int64_t(0), MaxCellCoordinate));
+    uint64_t z = uint64_t(std::clamp(int64_t(std::floor(cell.z)), int64_t(0), MaxCellCoordinate));
+
+    // Offset by one so that no key is zero
+    return (x | (y << 20) | (z << 40) | (normal << 60)) + 1;
+}
+
+void RadianceCache::record(const Vec3& p, const Vec3& n, const Vec3& gathered, const Vec3& weight)
+{
+    uint64_t k = key(p, n);
+    uint64_t slot = mixBits(k);
+
+    for (uint32_t i = 0; i < MaxProbes; ++i, ++slot)
+    {
+        Cell& cell = cells_[slot & mask_];
+        uint64_t current = cell.key.load(std::memory_order_relaxed);
+
+        if (current == 0 && cell.key.compare_exchange_strong(current, k, std::memory_order_relaxed))
+        {
+            current = k;
+        }
+
+        if (current != k)
+        {
+            continue;
+        }
+
+        for (int c = 0; c < 3; ++c)
+        {
+            if (weight[c] > 0.0)
+            {
+                uint64_t value = uint64_t(std::clamp(gathered[c] / weight[c], 0.0, MaxRecordedValue) * FixedPointScale);
+                cell.sums[c].fetch_add(value, std::memory_order_relaxed);
+                cell.counts[c].fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+
+        return;
+    }
+}
+
+bool RadianceCache::lookup(const Vec3& p, const Vec3& n, const Vec3& albedo, const Vec3& jitter, Vec3& radiance) const
+{
+    Vec3 offset = (jitter - Vec3(0.5, 0.5, 0.5)) * cellSize_;
+    uint64_t k = key(p + offset - n * dot(n, offset), n);
+    uint64_t slot = mixBits(k);
+
+    for (uint32_t i = 0; i < MaxProbes; ++i, ++slot)
+    {
+        const Cell& cell = cells_[slot & mask_];
+        uint64_t current = cell.key.load(std::memory_order_relaxed);
+
+        if (current == 0)
+        {
+            return false;
+        }
+
+        if (current != k)
+        {
+            continue;
+        }
+
+        for (int c = 0; c < 3; ++c)
+        {
+            uint32_t count = cell.counts[c].load(std::memory_order_relaxed);
+
+            if (albedo[c] <= 0.0)
+            {
+                radiance[c] = 0.0;
+            }
+            else if (count < MinRecords)
+            {
+                return false;
+            }
+            else
+            {
+                radiance[c] = albedo[c] * double(cell.sums[c].load(std::memory_order_relaxed)) / (FixedPointScale * count);
+            }
+        }
+
+        return true;
+    }
+
+    return false;
+}
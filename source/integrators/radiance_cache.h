@@ -0,0 +1,44 @@
+#pragma once
+
+#include "core/aabb.h"
+#include "core/vec3.h"
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+
+// Light reflected by diffuse surfaces, averaged over the cells of a world space grid. Cells are created on demand in a
+// hash table keyed by the cell and the dominant axis of the surface normal, so only the surfaces paths actually reach
+// use memory. Radiance is stored divided by the albedo where it was recorded and multiplied by the albedo where it's
+// looked up, so texture detail survives.
+class RadianceCache
+{
+public:
+    // resolution cells span the largest side of bounds
+    RadianceCache(const Aabb& bounds, uint32_t resolution);
+
+    // Thread safe. gathered is the light a path collected after reaching p and weight is its throughput up to p times
+    // the albedo there. Channels with zero weight say nothing about the light at p and are skipped.
+    void record(const Vec3& p, const Vec3& n, const Vec3& gathered, const Vec3& weight);
+
+    // Returns the light reflected from p. jitter is uniform in [0, 1)^3 and offsets the lookup within a cell sized
+    // square in the tangent plane, which hides the cell boundaries. Returns false when the cell has too few records
+    // to be trusted in any channel albedo doesn't zero out.
+    bool lookup(const Vec3& p, const Vec3& n, const Vec3& albedo, const Vec3& jitter, Vec3& radiance) const;
+
+private:
+    struct Cell
+    {
+        std::atomic<uint64_t> key{ 0 };    // Zero for unused cells
+        std::atomic<uint64_t> sums[3]{};   // Fixed point, so averages don't depend on thread timing
+        std::atomic<uint32_t> counts[3]{};
+    };
+
+    uint64_t key(const Vec3& p, const Vec3& n) const;
+
+    Vec3 origin_;
+    double cellSize_;
+    double invCellSize_;
+    uint64_t mask_;
+    std::unique_ptr<Cell[]> cells_;
+};
@@ -0,0 +1,650 @@
+#include "wavefront_integrator.h"
+
+#include "core/hit_record.h"
+#include "core/sampler.h"
+#include "core/sampling.h"
+#include "materials/material.h"
+#include "scenes/scene.h"
+
+#include <algorithm>
+#include <chrono>
+#include <limits>
+#include <utility>
+#include <vector>
+
+// Never survive roulette with certainty, matches PathIntegrator
+constexpr double MaxSurvivalProbability = 0.95;
+
+// Used when CreateInfo::maxPaths is 0
+constexpr uint32_t DefaultMaxPaths = 1u << 14;
+
+// Bits per axis of the origin cells bounced rays are sorted by, with the octant that makes 30 bit keys
+constexpr uint32_t MortonBits = 9;
+
+// Bits per axis of the coarser cells the coherence statistic compares
+constexpr uint32_t CoherenceBits = 5;
+
+// Spreads the low 10 bits of x out to every third bit
+static uint32_t expandBits(uint32_t x)
+{
+    x = (x | (x << 16)) & 0x030000ff;
+    x = (x | (x << 8)) & 0x0300f00f;
+    x = (x | (x << 4)) & 0x030c30c3;
+    x = (x | (x << 2)) & 0x09249249;
+    return x;
+}
+
+// Direction octant in the top bits, then the Morton code of the origin's cell within bounds
+static uint32_t rayKey(const Aabb& bounds, const Vec3& origin, const Vec3& direction)
+{
+    Vec3 extents = bounds.extents();
+    uint32_t cell[3];
+
+    for (int a = 0; a < 3; ++a)
+    {
+        double u = extents[a] > 0.0 ? (origin[a] - bounds.mins[a]) / extents[a] : 0.0;
+        cell[a] = uint32_t(std::clamp(u, 0.0, 1.0) * ((1u << MortonBits) - 1));
+    }
+
+    uint32_t octant = (direction.x < 0.0 ? 1 : 0) | (direction.y < 0.0 ? 2 : 0) | (direction.z < 0.0 ? 4 : 0);
+    return (octant << (3 * MortonBits)) | (expandBits(cell[0]) << 2) | (expandBits(cell[1]) << 1) | expandBits(cell[2]);
+}
+
+// A light or sky sample waiting for its shadow ray
+struct ShadowRay
+{
+    uint32_t path;
+    bool sky;               // Adds the sky if the ray escapes, otherwise whatever emitter it hits
+    Sampler::State state;   // Where the sampler left off in the light or sky dimension
+    Vec3 origin;
+    Vec3 direction;
+    double time;
+    Vec3 throughput;
+    Vec3 f;
+    double scale;           // MIS weight over the light or sky pdf, just that pdf until the BSDF has been evaluated
+    Vec3 radiance;          // Filled in once traced
+    bool contributes;       // The ray reached what it was aimed at
+};
+
+struct WavefrontIntegrator::Workspace
+{
+    std::unique_ptr<Sampler> sampler;
+
+    // Path state
+    std::vector<Vec3> origins;
+    std::vector<Vec3> directions;
+    std::vector<double> times;
+    std::vector<double> coneWidths;
+    std::vector<double> coneSpreads;
+    std::vector<Vec3> throughputs;
+    std::vector<double> lastPdfs;
+    std::vector<uint8_t> specularBounces;
+    std::vector<uint32_t> bounces[3];
+    std::vector<HitRecord> hits;
+    std::vector<uint8_t> found;
+    std::vector<uint8_t> alive;
+    std::vector<Vec3> radiance;
+
+    // Queues of path indices, kept in ascending order apart from the shading queue and the tracing order
+    std::vector<uint32_t> active;
+    std::vector<uint32_t> traceOrder;
+    std::vector<uint64_t> rayKeys;      // Key in the high half, path index in the low half
+    std::vector<std::pair<const IMaterial*, uint32_t>> materialKeys;  // Material and path of each hit to shade
+    std::vector<uint32_t> shadeQueue;
+    std::vector<std::pair<const ITexture*, uint32_t>> albedoKeys;  // Albedo texture and path of each hit to shade
+    std::vector<uint32_t> albedoQueue;                              // Paths of the hits sharing one texture
+    std::vector<Vec3> albedos;
+    TextureScratch textureScratch;
+    std::vector<ShadowRay> shadowQueue;
+
+    // One material's batch, element k belongs to the k-th path of the batch
+    std::vector<Vec3> emitted;
+    std::vector<double> bsdfNumbers;
+    std::vector<double> rouletteNumbers;
+    std::vector<BsdfSample> bsdfSamples;
+    std::vector<uint8_t> scattered;
+    std::vector<ShadowRay> lightSamples;
+    std::vector<uint32_t> lightPaths;
+    std::vector<Vec3> lightDirections;
+    std::vector<Vec3> lightF;
+    std::vector<double> lightBsdfPdfs;
+};
+
+WavefrontIntegrator::WavefrontIntegrator(const CreateInfo& createInfo)
+    : info_(createInfo)
+    , stats_(std::make_shared<Stats>())
+{
+    if (info_.maxPaths == 0)
+    {
+        info_.maxPaths = DefaultMaxPaths;
+    }
+}
+
+std::shared_ptr<WavefrontIntegrator::Workspace> WavefrontIntegrator::createWorkspace(const Sampler& sampler) const
+{
+    auto workspace = std::make_shared<Workspace>();
+    workspace->sampler = sampler.clone();
+    workspace->sampler->setIndependentDimensions(true);
+    return workspace;
+}
+
+void WavefrontIntegrator::renderTile(const Scene& scene, Workspace& workspace, uint32_t x0, uint32_t y0, uint32_t tileWidth,
+                                     uint32_t tileHeight, uint32_t width, uint32_t height, uint32_t firstSample,
+                                     uint32_t numSamples, Vec3* colors) const
+{
+    // Path p is sample firstSample + p / tilePixels of the tile's pixel p % tilePixels, so adding them up in path order
+    // keeps each pixel's samples in order
+    uint32_t tilePixels = tileWidth * tileHeight;
+    uint32_t numPaths = tilePixels * numSamples;
+
+    for (uint32_t firstPath = 0; firstPath < numPaths; firstPath += info_.maxPaths)
+    {
+        uint32_t wavePaths = std::min(numPaths - firstPath, info_.maxPaths);
+        renderWave(scene, workspace, x0, y0, tileWidth, tilePixels, width, height, firstSample * tilePixels + firstPath, wavePaths);
+
+        for (uint32_t i = 0; i < wavePaths; ++i)
+        {
+            colors[(firstPath + i) % tilePixels] += workspace.radiance[i];
+        }
+    }
+}
+
+void WavefrontIntegrator::renderWave(const Scene& scene, Workspace& workspace, uint32_t x0, uint32_t y0, uint32_t tileWidth,
+                                     uint32_t tilePixels, uint32_t width, uint32_t height, uint32_t firstPath, uint32_t numPaths) const
+{
+    using Clock = std::chrono::steady_clock;
+
+    auto record = [this](Stage stage, size_t items, Clock::time_point start)
+    {
+        stats_->items[int(stage)] += items;
+        stats_->nanoseconds[int(stage)] += uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count());
+    };
+
+    // Every stage visits paths out of order, so each one puts the sampler back at its path's pixel sample first
+    auto startPath = [firstPath, tilePixels, tileWidth, x0, y0](Sampler& pathSampler, uint32_t i)
+    {
+        uint32_t p = firstPath + i;
+        uint32_t pixel = p % tilePixels;
+        pathSampler.startPixelSample(x0 + pixel % tileWidth, y0 + pixel / tileWidth, p / tilePixels);
+    };
+
+    Sampler& sampler = *workspace.sampler;
+    const uint32_t maxBounces[3] = { info_.maxDiffuseDepth, info_.maxSpecularDepth, info_.maxVolumeDepth };
+    bool lightSampling = info_.lightSampling && !scene.lights.empty();
+
+    // Sized for this wave, the buffers only grow the first time
+    std::vector<Vec3>& origins = workspace.origins;
+    std::vector<Vec3>& directions = workspace.directions;
+    std::vector<double>& times = workspace.times;
+    std::vector<double>& coneWidths = workspace.coneWidths;
+    std::vector<double>& coneSpreads = workspace.coneSpreads;
+    std::vector<Vec3>& throughputs = workspace.throughputs;
+    std::vector<double>& lastPdfs = workspace.lastPdfs;
+    std::vector<uint8_t>& specularBounces = workspace.specularBounces;
+    std::vector<uint32_t>* bounces = workspace.bounces;
+    std::vector<HitRecord>& hits = workspace.hits;
+    std::vector<uint8_t>& found = workspace.found;
+    std::vector<uint8_t>& alive = workspace.alive;
+    std::vector<Vec3>& radiance = workspace.radiance;
+    std::vector<uint32_t>& active = workspace.active;
+    std::vector<uint32_t>& traceOrder = workspace.traceOrder;
+    std::vector<uint64_t>& rayKeys = workspace.rayKeys;
+    std::vector<uint32_t>& shadeQueue = workspace.shadeQueue;
+    std::vector<ShadowRay>& shadowQueue = workspace.shadowQueue;
+
+    origins.resize(numPaths);
+    directions.resize(numPaths);
+    times.resize(numPaths);
+    coneWidths.resize(numPaths);
+    coneSpreads.resize(numPaths);
+    throughputs.assign(numPaths, Vec3(1, 1, 1));
+    lastPdfs.assign(numPaths, 0.0);
+    specularBounces.assign(numPaths, 1);
+    hits.resize(numPaths);
+    found.resize(numPaths);
+    alive.resize(numPaths);
+    radiance.assign(numPaths, Vec3(0, 0, 0));
+    active.resize(numPaths);
+
+    for (int type = 0; type < 3; ++type)
+    {
+        bounces[type].assign(numPaths, 0);
+    }
+
+    Clock::time_point start = Clock::now();
+
+    for (uint32_t i = 0; i < numPaths; ++i)
+    {
+        uint32_t pixel = (firstPath + i) % tilePixels;
+        uint32_t x = x0 + pixel % tileWidth;
+        uint32_t y = y0 + pixel / tileWidth;
+        startPath(sampler, i);
+        double u = double(x + sampler()) / width;
+        double v = double(y + sampler()) / height;
+        Ray r = scene.camera->createRay(sampler, u, v);
+        origins[i] = r.origin;
+        directions[i] = r.direction;
+        times[i] = r.time;
+        coneWidths[i] = r.coneWidth;
+        coneSpreads[i] = r.coneSpread;
+        active[i] = i;
+    }
+
+    record(Stage::Generate, numPaths, start);
+
+    // Bounced rays head off in every direction. With sortRays, those that start close together in similar directions
+    // are traced one after another, so consecutive rays tend to visit the same BVH nodes. Every path's hit only depends
+    // on its own state, so the order doesn't change the image.
+    Aabb bounds;
+    bool bounded = scene.boundingBox(scene.cameraCreateInfo.timeBegin, scene.cameraCreateInfo.timeEnd, bounds);
+    bool sortRays = info_.sortRays && bounded;
+
+    for (uint32_t depth = 0; depth < info_.maxDepth && !active.empty(); ++depth)
+    {
+        start = Clock::now();
+        traceOrder = active;
+
+        if (depth > 0 && sortRays)
+        {
+            rayKeys.clear();
+
+            for (uint32_t i : active)
+            {
+                rayKeys.push_back((uint64_t(rayKey(bounds, origins[i], directions[i])) << 32) | i);
+            }
+
+            std::sort(rayKeys.begin(), rayKeys.end());
+
+            // How many consecutive rays share a coarse cell, as a measure of what the sort achieved
+            uint64_t coherentPairs = 0;
+            uint32_t shift = 32 + 3 * (MortonBits - CoherenceBits);
+
+            for (size_t k = 0; k < rayKeys.size(); ++k)
+            {
+                traceOrder[k] = uint32_t(rayKeys[k]);
+                coherentPairs += (k > 0 && (rayKeys[k] >> shift) == (rayKeys[k - 1] >> shift)) ? 1 : 0;
+            }
+
+            stats_->rayPairs += rayKeys.size() - 1;
+            stats_->coherentPairs += coherentPairs;
+            record(Stage::Sort, rayKeys.size(), start);
+            start = Clock::now();
+        }
+
+        for (uint32_t i : traceOrder)
+        {
+            startPath(sampler, i);
+            sampler.startDimension(depth, Sampler::Dimension::Medium);
+            Ray ray(origins[i], directions[i], times[i], depth == 0, &sampler);
+            hits[i] = HitRecord{};
+            found[i] = scene.hit(ray, 0.001, std::numeric_limits<double>::infinity(), hits[i]);
+        }
+
+        record(Stage::Intersect, active.size(), start);
+        start = Clock::now();
+
+        // Escaped paths pick up the sky, the rest are sorted by material so that each material shades its hits in one
+        // batch. The order of the materials' addresses only changes the order paths are shaded in.
+        std::vector<std::pair<const IMaterial*, uint32_t>>& materialKeys = workspace.materialKeys;
+        materialKeys.clear();
+
+        for (uint32_t i : active)
+        {
+            alive[i] = false;
+
+            if (!found[i])
+            {
+                double weight = 1.0;
+
+                if (info_.lightSampling && !specularBounces[i])
+                {
+                    weight = powerHeuristic(lastPdfs[i], scene.sky->pdf(directions[i]));
+                }
+
+                // Filtered only when seen through delta bounces, as in PathIntegrator
+                double spread = specularBounces[i] ? coneSpreads[i] : 0.0;
+                radiance[i] += throughputs[i] * scene.sky->sampleCone(directions[i], spread) * weight;
+                continue;
+            }
+
+            hits[i].footprint = coneWidths[i] + coneSpreads[i] * hits[i].t;
+            materialKeys.emplace_back(hits[i].material, i);
+        }
+
+        std::sort(materialKeys.begin(), materialKeys.end());
+        shadeQueue.resize(materialKeys.size());
+
+        for (size_t k = 0; k < materialKeys.size(); ++k)
+        {
+            shadeQueue[k] = materialKeys[k].second;
+        }
+
+        // Each texture looks up the albedos of all its hits in one batch, in the order of the textures' addresses, which
+        // only changes the order lookups are made in
+        std::vector<std::pair<const ITexture*, uint32_t>>& albedoKeys = workspace.albedoKeys;
+        std::vector<uint32_t>& albedoQueue = workspace.albedoQueue;
+        std::vector<Vec3>& albedos = workspace.albedos;
+        albedoKeys.clear();
+
+        for (uint32_t i : shadeQueue)
+        {
+            albedoKeys.emplace_back(hits[i].material->albedoTexture(), i);
+        }
+
+        std::sort(albedoKeys.begin(), albedoKeys.end());
+
+        for (size_t first = 0; first < albedoKeys.size();)
+        {
+            const ITexture* texture = albedoKeys[first].first;
+            size_t last = first + 1;
+            albedoQueue.clear();
+            albedoQueue.push_back(albedoKeys[first].second);
+
+            while (last < albedoKeys.size() && albedoKeys[last].first == texture)
+            {
+                albedoQueue.push_back(albedoKeys[last++].second);
+            }
+
+            if (texture)
+            {
+                uint32_t count = uint32_t(albedoQueue.size());
+                albedos.resize(count);
+                texture->sampleBatch(hits.data(), albedoQueue.data(), count, albedos.data(), workspace.textureScratch);
+
+                for (uint32_t k = 0; k < count; ++k)
+                {
+                    hits[albedoQueue[k]].albedo = albedos[k];
+                    hits[albedoQueue[k]].hasAlbedo = true;
+                }
+            }
+
+            first = last;
+        }
+
+        shadowQueue.clear();
+
+        for (size_t first = 0; first < shadeQueue.size();)
+        {
+            const IMaterial* material = hits[shadeQueue[first]].material;
+            size_t last = first + 1;
+
+            while (last < shadeQueue.size() && hits[shadeQueue[last]].material == material)
+            {
+                ++last;
+            }
+
+            const uint32_t* paths = shadeQueue.data() + first;
+            uint32_t count = uint32_t(last - first);
+            first = last;
+
+            std::vector<Vec3>& emitted = workspace.emitted;
+            emitted.resize(count);
+            material->emittedBatch(hits.data(), paths, count, emitted.data());
+
+            for (uint32_t k = 0; k < count; ++k)
+            {
+                uint32_t i = paths[k];
+
+                if (emitted[k] != Vec3(0, 0, 0))
+                {
+                    double weight = 1.0;
+
+                    if (lightSampling && !specularBounces[i])
+                    {
+                        weight = powerHeuristic(lastPdfs[i], scene.lights.pdfValue(origins[i], directions[i], times[i]));
+                    }
+
+                    radiance[i] += throughputs[i] * emitted[k] * weight;
+                }
+            }
+
+            // The BSDF's and roulette's numbers are drawn up front, so the whole batch is sampled in one call. Every
+            // dimension draws the same numbers in any order, and a number drawn for a path that stops is never used.
+            std::vector<double>& bsdfNumbers = workspace.bsdfNumbers;
+            std::vector<double>& rouletteNumbers = workspace.rouletteNumbers;
+            std::vector<BsdfSample>& bsdfSamples = workspace.bsdfSamples;
+            std::vector<uint8_t>& scattered = workspace.scattered;
+            bool roulette = depth + 1 >= info_.rouletteDepth;
+            bsdfNumbers.resize(2 * size_t(count));
+            rouletteNumbers.resize(count);
+            bsdfSamples.resize(count);
+            scattered.resize(count);
+
+            for (uint32_t k = 0; k < count; ++k)
+            {
+                startPath(sampler, paths[k]);
+                sampler.startDimension(depth, Sampler::Dimension::Bsdf);
+                bsdfNumbers[2 * k] = sampler();
+                bsdfNumbers[2 * k + 1] = sampler();
+
+                if (roulette)
+                {
+                    sampler.startDimension(depth, Sampler::Dimension::Roulette);
+                    rouletteNumbers[k] = sampler();
+                }
+            }
+
+            material->sampleBatch(hits.data(), directions.data(), paths, count, bsdfNumbers.data(), bsdfSamples.data(), scattered.data());
+
+            // Light and sky directions are drawn for the paths that scattered, then the material evaluates all of them
+            std::vector<ShadowRay>& lightSamples = workspace.lightSamples;
+            std::vector<uint32_t>& lightPaths = workspace.lightPaths;
+            std::vector<Vec3>& lightDirections = workspace.lightDirections;
+            lightSamples.clear();
+            lightPaths.clear();
+            lightDirections.clear();
+
+            for (uint32_t k = 0; k < count; ++k)
+            {
+                uint32_t i = paths[k];
+                const BsdfSample& bsdf = bsdfSamples[k];
+
+                if (!scattered[k] || ++bounces[int(bsdf.type)][i] > maxBounces[int(bsdf.type)])
+                {
+                    scattered[k] = false;
+                    continue;
+                }
+
+                specularBounces[i] = bsdf.delta;
+
+                if (!info_.lightSampling || bsdf.delta || depth + 1 >= info_.maxDepth)
+                {
+                    continue;
+                }
+
+                const HitRecord& hit = hits[i];
+                startPath(sampler, i);
+
+                if (lightSampling)
+                {
+                    sampler.startDimension(depth, Sampler::Dimension::Light);
+                    Vec3 direction = scene.lights.sampleDirection(sampler, hit.p, times[i]);
+                    lightSamples.push_back({ i, false, sampler.state(), hit.p, direction, times[i], throughputs[i], Vec3(0, 0, 0), 0.0, Vec3(0, 0, 0), false });
+                    lightPaths.push_back(i);
+                    lightDirections.push_back(direction);
+                }
+
+                sampler.startDimension(depth, Sampler::Dimension::Sky);
+                Vec3 direction;
+                double skyPdf;
+
+                if (scene.sky->sampleDirection(sampler, direction, skyPdf))
+                {
+                    lightSamples.push_back({ i, true, sampler.state(), hit.p, direction, times[i], throughputs[i], Vec3(0, 0, 0), skyPdf, Vec3(0, 0, 0), false });
+                    lightPaths.push_back(i);
+                    lightDirections.push_back(direction);
+                }
+            }
+
+            std::vector<Vec3>& lightF = workspace.lightF;
+            std::vector<double>& lightBsdfPdfs = workspace.lightBsdfPdfs;
+            uint32_t numLightSamples = uint32_t(lightSamples.size());
+            lightF.resize(numLightSamples);
+            lightBsdfPdfs.resize(numLightSamples);
+            material->evalBatch(hits.data(), directions.data(), lightPaths.data(), lightDirections.data(), numLightSamples, lightF.data(),
+                                lightBsdfPdfs.data());
+
+            // Their shadow rays are traced by the next stage
+            for (uint32_t k = 0; k < numLightSamples; ++k)
+            {
+                ShadowRay& shadow = lightSamples[k];
+
+                if (lightF[k] == Vec3(0, 0, 0))
+                {
+                    continue;
+                }
+
+                shadow.f = lightF[k];
+
+                if (shadow.sky)
+                {
+                    shadow.scale = powerHeuristic(shadow.scale, lightBsdfPdfs[k]) / shadow.scale;
+                    shadowQueue.push_back(shadow);
+                    continue;
+                }
+
+                double lightPdf = scene.lights.pdfValue(shadow.origin, shadow.direction, shadow.time);
+
+                if (lightPdf > 0)
+                {
+                    shadow.scale = powerHeuristic(lightPdf, lightBsdfPdfs[k]) / lightPdf;
+                    shadowQueue.push_back(shadow);
+                }
+            }
+
+            for (uint32_t k = 0; k < count; ++k)
+            {
+                uint32_t i = paths[k];
+                const BsdfSample& bsdf = bsdfSamples[k];
+                Vec3& throughput = throughputs[i];
+
+                if (!scattered[k] || bsdf.pdf <= 0.0 || bsdf.f == Vec3(0, 0, 0))
+                {
+                    continue;
+                }
+
+                lastPdfs[i] = bsdf.pdf;
+                throughput *= bsdf.f / bsdf.pdf;
+
+                if (roulette)
+                {
+                    double survival = std::min(std::max(throughput.x, std::max(throughput.y, throughput.z)), MaxSurvivalProbability);
+
+                    if (rouletteNumbers[k] >= survival)
+                    {
+                        continue;
+                    }
+
+                    throughput /= survival;
+                }
+
+                origins[i] = hits[i].p;
+                directions[i] = bsdf.wi;
+                coneWidths[i] = hits[i].footprint;
+                coneSpreads[i] = scatteredConeSpread(coneSpreads[i], bsdf);
+                alive[i] = true;
+            }
+        }
+
+        record(Stage::Shade, shadeQueue.size(), start);
+        start = Clock::now();
+
+        // Shadow rays are traced in key order too when sorting, but added up in queue order, which is the order
+        // PathIntegrator adds them in, so the sums round the same way
+        traceOrder.resize(shadowQueue.size());
+
+        if (sortRays)
+        {
+            rayKeys.clear();
+
+            for (uint32_t k = 0; k < shadowQueue.size(); ++k)
+            {
+                rayKeys.push_back((uint64_t(rayKey(bounds, shadowQueue[k].origin, shadowQueue[k].direction)) << 32) | k);
+            }
+
+            std::sort(rayKeys.begin(), rayKeys.end());
+
+            for (size_t k = 0; k < rayKeys.size(); ++k)
+            {
+                traceOrder[k] = uint32_t(rayKeys[k]);
+            }
+
+            record(Stage::Sort, rayKeys.size(), start);
+            start = Clock::now();
+        }
+        else
+        {
+            for (uint32_t k = 0; k < shadowQueue.size(); ++k)
+            {
+                traceOrder[k] = k;
+            }
+        }
+
+        // Media attenuate the shadow rays that reach what they were aimed at, hit() drew nothing for them so their
+        // draws carry on from the same point
+        for (uint32_t k : traceOrder)
+        {
+            ShadowRay& shadow = shadowQueue[k];
+            startPath(sampler, shadow.path);
+            sampler.restore(shadow.state);
+            Ray shadowRay(shadow.origin, shadow.direction, shadow.time, false, &sampler, true);
+            HitRecord shadowHit{};
+            bool blocked = scene.hit(shadowRay, 0.001, std::numeric_limits<double>::infinity(), shadowHit);
+
+            if (shadow.sky && !blocked)
+            {
+                double transmittance = scene.transmittance(shadowRay, 0.001, std::numeric_limits<double>::infinity());
+                shadow.radiance = shadow.throughput * (shadow.f * scene.sky->Sample(shadow.direction) * shadow.scale * transmittance);
+                shadow.contributes = true;
+            }
+            else if (!shadow.sky && blocked)
+            {
+                Vec3 emitted = shadowHit.material->emitted(shadowHit);
+
+                if (emitted != Vec3(0, 0, 0))
+                {
+                    double transmittance = scene.transmittance(shadowRay, 0.001, shadowHit.t);
+                    shadow.radiance = shadow.throughput * (shadow.f * emitted * shadow.scale * transmittance);
+                    shadow.contributes = true;
+                }
+            }
+        }
+
+        for (const ShadowRay& shadow : shadowQueue)
+        {
+            if (shadow.contributes)
+            {
+                radiance[shadow.path] += shadow.radiance;
+            }
+        }
+
+        record(Stage::Shadow, shadowQueue.size(), start);
+
+        active.erase(std::remove_if(active.begin(), active.end(), [&alive](uint32_t i) { return !alive[i]; }), active.end());
+    }
+}
+
+void WavefrontIntegrator::printStats(std::ostream& out) const
+{
+    static const char* names[int(Stage::Count)] = { "Generate", "Sort", "Intersect", "Shade", "Shadow" };
+
+    for (int stage = 0; stage < int(Stage::Count); ++stage)
+    {
+        uint64_t items = stats_->items[stage];
+        double seconds = double(stats_->nanoseconds[stage]) * 1e-9;
+        out << names[stage] << ": " << items << " items, " << seconds << " s";
+
+        if (seconds > 0.0)
+        {
+            out << ", " << double(items) / seconds * 1e-6 << " M/s";
+        }
+
+        out << "\n";
+    }
+
+    if (stats_->rayPairs > 0)
+    {
+        out << "Sorted bounced rays: " << 100.0 * double(stats_->coherentPairs) / double(stats_->rayPairs)
+            << "% of consecutive rays share a direction octant and origin cell\n";
+    }
+}
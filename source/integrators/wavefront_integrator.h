@@ -0,0 +1,81 @@
+#pragma once
+
+#include "core/vec3.h"
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <ostream>
+
+class Sampler;
+class Scene;
+
+// Traces the pixel samples of a whole tile at once, one stage at a time: camera rays are generated, intersected in bulk,
+// then their hits are grouped by material and each group is shaded with one batched call, which queues the shadow rays
+// that are traced last. Path state and queues are kept as structures of arrays. Computes the same estimator from the same
+// sample dimensions as PathIntegrator, without guiding, the radiance cache, photon mapping or path splitting, so with the
+// sobol and blue noise samplers both render the same image.
+class WavefrontIntegrator
+{
+public:
+    // Width and height of the tiles of pixels whose samples are traced together
+    static constexpr uint32_t TileSize = 16;
+
+    struct CreateInfo
+    {
+        uint32_t maxDepth;
+        uint32_t maxDiffuseDepth;
+        uint32_t maxSpecularDepth;
+        uint32_t maxVolumeDepth;
+        uint32_t rouletteDepth;     // Bounces before Russian roulette kicks in
+        bool lightSampling;         // Next event estimation against Scene::lights and the sky
+        uint32_t maxPaths;          // Paths in flight per wave, larger tiles are split into several waves
+        bool sortRays;              // Trace bounced and shadow rays in order of direction octant and origin Morton code
+    };
+
+    // Path state, queues and samplers, kept by each job for every tile it renders so that waves don't allocate
+    struct Workspace;
+
+    WavefrontIntegrator(const CreateInfo& createInfo);
+
+    // The workspace's samplers are copies of sampler, switched to independent dimensions because stages visit a path's
+    // dimensions out of order
+    std::shared_ptr<Workspace> createWorkspace(const Sampler& sampler) const;
+
+    // Adds pixel samples [firstSample, firstSample + numSamples) of each pixel in the tile at (x0, y0) to colors, which
+    // holds the tile's pixels row by row, in sample order
+    void renderTile(const Scene& scene, Workspace& workspace, uint32_t x0, uint32_t y0, uint32_t tileWidth, uint32_t tileHeight,
+                    uint32_t width, uint32_t height, uint32_t firstSample, uint32_t numSamples, Vec3* colors) const;
+
+    // Items processed and time spent by each stage, summed over every job, and with sortRays how coherent the sorted
+    // bounced rays are
+    void printStats(std::ostream& out) const;
+
+private:
+    enum class Stage
+    {
+        Generate,
+        Sort,
+        Intersect,
+        Shade,
+        Shadow,
+        Count
+    };
+
+    struct Stats
+    {
+        std::atomic<uint64_t> items[int(Stage::Count)]{};
+        std::atomic<uint64_t> nanoseconds[int(Stage::Count)]{};
+
+        // Consecutive bounced rays in tracing order, and those of them that share a direction octant and coarse origin
+        // cell, as a measure of how coherent the order is
+        std::atomic<uint64_t> rayPairs{};
+        std::atomic<uint64_t> coherentPairs{};
+    };
+
+    void renderWave(const Scene& scene, Workspace& workspace, uint32_t x0, uint32_t y0, uint32_t tileWidth, uint32_t tilePixels,
+                    uint32_t width, uint32_t height, uint32_t firstPath, uint32_t numPaths) const;
+
+    CreateInfo info_;
+    std::shared_ptr<Stats> stats_;  // Updated by every job's renderTile() calls
+};
@@ -1,39 +1,216 @@
 #include "material.h"
 
-#include "core/rng.h"
+#include "core/hit_record.h"
 #include "core/rtiow.h"
-#include "shapes/hittable.h"
+#include "core/sampler.h"
+#include "core/sampling.h"
 
-bool Lambertian::scatter(Rng& rng, const Ray& in, const HitRecord& hit, Vec3& attenuation, Ray& scattered) const
+#include <algorithm>
+#include <cmath>
+
+bool IMaterial::sample(Sampler& sampler, const HitRecord& hit, const Vec3& wo, BsdfSample& sample) const
+{
+    double u0 = sampler();
+    double u1 = sampler();
+    return this->sample(u0, u1, hit, wo, sample);
+}
+
+void IMaterial::emittedBatch(const HitRecord* hits, const uint32_t* paths, uint32_t count, Vec3* emitted) const
+{
+    for (uint32_t k = 0; k < count; ++k)
+    {
+        emitted[k] = this->emitted(hits[paths[k]]);
+    }
+}
+
+void IMaterial::sampleBatch(const HitRecord* hits, const Vec3* directions, const uint32_t* paths, uint32_t count, const double* u,
+                            BsdfSample* samples, uint8_t* scattered) const
+{
+    for (uint32_t k = 0; k < count; ++k)
+    {
+        uint32_t i = paths[k];
+        scattered[k] = sample(u[2 * k], u[2 * k + 1], hits[i], -directions[i], samples[k]);
+    }
+}
+
+void IMaterial::evalBatch(const HitRecord* hits, const Vec3* directions, const uint32_t* paths, const Vec3* wis, uint32_t count,
+                          Vec3* f, double* pdfs) const
 {
-    Vec3 scatterDirection = hit.n + rng.inUnitSphere();
+    for (uint32_t k = 0; k < count; ++k)
+    {
+        uint32_t i = paths[k];
+        f[k] = eval(hits[i], -directions[i], wis[k]);
+        pdfs[k] = pdf(hits[i], -directions[i], wis[k]);
+    }
+}
 
-    if (length2(scatterDirection) < std::numeric_limits<double>::epsilon())
+bool Lambertian::sample(double u0, double u1, const HitRecord& hit, const Vec3& wo, BsdfSample& sample) const
+{
+    Vec3 local = squareToCosineHemisphere(u0, u1);
+
+    if (local.z <= 0)
     {
         return false;
     }
 
-    attenuation = albedo(hit);
-    scattered = { hit.p, normalize(scatterDirection), in.time, false, in.rng };
+    sample.wi = localToWorld(hit.n, local);
+    sample.pdf = local.z / pi;
+    sample.f = albedo(hit) * (local.z / pi);
+    sample.type = ScatterType::Diffuse;
+    sample.delta = false;
     return true;
 }
 
-bool Metal::scatter(Rng& rng, const Ray& in, const HitRecord& hit, Vec3& attenuation, Ray& scattered) const
+Vec3 Lambertian::eval(const HitRecord& hit, const Vec3& wo, const Vec3& wi) const
 {
-    Vec3 reflected = reflect(in.direction, hit.n);
-    Vec3 scatterDirection = reflected + rng.inUnitSphere() * roughness_;
+    double cosine = dot(hit.n, wi);
+    return (cosine > 0) ? albedo(hit) * (cosine / pi) : Vec3(0, 0, 0);
+}
 
-    if (dot(scatterDirection, hit.n) <= 0)
+double Lambertian::pdf(const HitRecord& hit, const Vec3& wo, const Vec3& wi) const
+{
+    return std::max(dot(hit.n, wi), 0.0) / pi;
+}
+
+// Fuzz values below this are treated as a perfect mirror
+constexpr double MinMetalAlpha = 1e-3;
+
+static Vec3 schlickFresnel(const Vec3& f0, double cosine)
+{
+    return f0 + (Vec3(1, 1, 1) - f0) * std::pow(1.0 - clamp(cosine, 0.0, 1.0), 5);
+}
+
+// GGX distribution and Smith masking, in the local frame where the normal is +z
+static double ggxD(const Vec3& m, double alpha)
+{
+    double a2 = alpha * alpha;
+    double d = m.z * m.z * (a2 - 1.0) + 1.0;
+    return a2 / (pi * d * d);
+}
+
+static double ggxLambda(const Vec3& v, double alpha)
+{
+    double cos2 = v.z * v.z;
+    double tan2 = std::max(1.0 - cos2, 0.0) / cos2;
+    return (std::sqrt(1.0 + alpha * alpha * tan2) - 1.0) * 0.5;
+}
+
+// Heitz 2018, "Sampling the GGX Distribution of Visible Normals"
+static Vec3 sampleGgxVisibleNormal(const Vec3& wo, double alpha, double u0, double u1)
+{
+    Vec3 vh = normalize(Vec3(alpha * wo.x, alpha * wo.y, wo.z));
+    double lengthSquared = vh.x * vh.x + vh.y * vh.y;
+    Vec3 t1 = (lengthSquared > 0) ? Vec3(-vh.y, vh.x, 0) / std::sqrt(lengthSquared) : Vec3(1, 0, 0);
+    Vec3 t2 = cross(vh, t1);
+
+    double r = std::sqrt(u0);
+    double phi = 2.0 * pi * u1;
+    double p1 = r * std::cos(phi);
+    double p2 = r * std::sin(phi);
+    double s = 0.5 * (1.0 + vh.z);
+    p2 = (1.0 - s) * std::sqrt(std::max(0.0, 1.0 - p1 * p1)) + s * p2;
+
+    Vec3 nh = t1 * p1 + t2 * p2 + vh * std::sqrt(std::max(0.0, 1.0 - p1 * p1 - p2 * p2));
+    return normalize(Vec3(alpha * nh.x, alpha * nh.y, std::max(0.0, nh.z)));
+}
+
+static Vec3 worldToLocal(const Vec3& n, const Vec3& v)
+{
+    Vec3 s;
+    Vec3 t;
+    makeBasis(n, s, t);
+    return Vec3(dot(v, s), dot(v, t), dot(v, n));
+}
+
+double Metal::alpha() const
+{
+    return roughness_ * roughness_;
+}
+
+double Metal::scatterSpread() const
+{
+    // A GGX lobe with alpha 1 is about as wide as a diffuse one
+    return (alpha() < MinMetalAlpha) ? 0.0 : std::min(alpha(), 1.0);
+}
+
+bool Metal::sample(double u0, double u1, const HitRecord& hit, const Vec3& wo, BsdfSample& sample) const
+{
+    double cosO = dot(wo, hit.n);
+
+    if (cosO <= 0)
     {
         return false;
     }
 
-    attenuation = albedo(hit);
-    scattered = { hit.p, normalize(scatterDirection), in.time, false, in.rng };
-    return true;
+    sample.type = ScatterType::Specular;
+
+    if (alpha() < MinMetalAlpha)
+    {
+        sample.wi = reflect(-wo, hit.n);
+        sample.pdf = 1.0;
+        sample.f = schlickFresnel(albedo(hit), cosO);
+        sample.delta = true;
+        return true;
+    }
+
+    Vec3 localWo = worldToLocal(hit.n, wo);
+    Vec3 m = sampleGgxVisibleNormal(localWo, alpha(), u0, u1);
+    Vec3 localWi = reflect(-localWo, m);
+
+    if (localWi.z <= 0)
+    {
+        return false;
+    }
+
+    sample.wi = localToWorld(hit.n, localWi);
+    sample.f = eval(hit, wo, sample.wi);
+    sample.pdf = pdf(hit, wo, sample.wi);
+    sample.delta = false;
+    return sample.pdf > 0;
+}
+
+Vec3 Metal::eval(const HitRecord& hit, const Vec3& wo, const Vec3& wi) const
+{
+    if (alpha() < MinMetalAlpha)
+    {
+        return Vec3(0, 0, 0);
+    }
+
+    Vec3 localWo = worldToLocal(hit.n, wo);
+    Vec3 localWi = worldToLocal(hit.n, wi);
+
+    if (localWo.z <= 0 || localWi.z <= 0)
+    {
+        return Vec3(0, 0, 0);
+    }
+
+    Vec3 m = normalize(localWo + localWi);
+    double g = 1.0 / (1.0 + ggxLambda(localWo, alpha()) + ggxLambda(localWi, alpha()));
+    return schlickFresnel(albedo(hit), dot(localWi, m)) * (ggxD(m, alpha()) * g / (4.0 * localWo.z));
 }
 
-Vec3 refract(const Vec3& uv, const Vec3& n, double etaiOverEtat)
+double Metal::pdf(const HitRecord& hit, const Vec3& wo, const Vec3& wi) const
+{
+    if (alpha() < MinMetalAlpha)
+    {
+        return 0.0;
+    }
+
+    Vec3 localWo = worldToLocal(hit.n, wo);
+    Vec3 localWi = worldToLocal(hit.n, wi);
+
+    if (localWo.z <= 0 || localWi.z <= 0)
+    {
+        return 0.0;
+    }
+
+    // Visible normal pdf, D_wo(m) = G1(wo) * max(0, wo.m) * D(m) / wo.z, and the Jacobian of the reflection
+    Vec3 m = normalize(localWo + localWi);
+    double g1 = 1.0 / (1.0 + ggxLambda(localWo, alpha()));
+    return g1 * ggxD(m, alpha()) / (4.0 * localWo.z);
+}
+
+static Vec3 refract(const Vec3& uv, const Vec3& n, double etaiOverEtat)
 {
     double cos_theta = std::min(dot(-uv, n), 1.0);
     Vec3 rOutPerp =  (uv + n * cos_theta) * etaiOverEtat;
@@ -41,7 +218,7 @@ Vec3 refract(const Vec3& uv, const Vec3& n, double etaiOverEtat)
     return rOutPerp + rOutParallel;
 }
 
-double reflectance(double cosine, double refractionRatio)
+static double reflectance(double cosine, double refractionRatio)
 {
     // Use Schlick's approximation for reflectance.
     double r0 = (1 - refractionRatio) / (1 + refractionRatio);
@@ -49,27 +226,31 @@ double reflectance(double cosine, double refractionRatio)
     return r0 + (1 - r0) * std::pow((1 - cosine), 5);
 }
 
-bool Dielectric::scatter(Rng& rng, const Ray& in, const HitRecord& hit, Vec3& attenuation, Ray& scattered) const
+bool Dielectric::sample(double u0, double u1, const HitRecord& hit, const Vec3& wo, BsdfSample& sample) const
 {
     double refractionRatio = hit.frontFace ? (1.0 / ior_) : ior_;
-    double cosTheta = std::min(dot(-in.direction, hit.n), 1.0);
+    double cosTheta = std::min(dot(wo, hit.n), 1.0);
     double sinTheta = std::sqrt(1.0 - cosTheta * cosTheta);
 
     bool cannotRefract = refractionRatio * sinTheta > 1.0;
+    double fresnel = cannotRefract ? 1.0 : reflectance(cosTheta, refractionRatio);
 
-    if (cannotRefract || reflectance(cosTheta, refractionRatio) > rng())
+    // Each lobe is picked with its Fresnel weight, so f / pdf is just the tint
+    if (u0 < fresnel)
     {
-        Vec3 reflected = normalize(reflect(in.direction, hit.n));
-        attenuation = albedo(hit);
-        scattered = { hit.p, reflected, in.time, false, in.rng };
+        sample.wi = normalize(reflect(-wo, hit.n));
+        sample.pdf = fresnel;
+        sample.f = albedo(hit) * fresnel;
     }
     else
     {
-        Vec3 refracted = normalize(refract(in.direction, hit.n, refractionRatio));
-        attenuation = albedo(hit);
-        scattered = { hit.p, refracted, in.time, false, in.rng };
+        sample.wi = normalize(refract(-wo, hit.n, refractionRatio));
+        sample.pdf = 1.0 - fresnel;
+        sample.f = albedo(hit) * (1.0 - fresnel);
     }
 
+    sample.type = ScatterType::Specular;
+    sample.delta = true;
     return true;
 }
 
@@ -78,9 +259,22 @@ Vec3 LightSource::emitted(const HitRecord& hit) const
     return hit.frontFace ? emitted_ : albedo(hit);
 }
 
-bool Isotropic::scatter(Rng& rng, const Ray& in, const HitRecord& hit, Vec3& attenuation, Ray& scattered) const
+bool Isotropic::sample(double u0, double u1, const HitRecord& hit, const Vec3& wo, BsdfSample& sample) const
 {
-    attenuation = albedo(hit);
-    scattered = { hit.p, rng.inUnitSphere(), in.time, false, in.rng };
+    sample.wi = squareToUniformSphere(u0, u1);
+    sample.pdf = 1.0 / (4.0 * pi);
+    sample.f = albedo(hit) / (4.0 * pi);
+    sample.type = ScatterType::Volume;
+    sample.delta = false;
     return true;
 }
+
+Vec3 Isotropic::eval(const HitRecord& hit, const Vec3& wo, const Vec3& wi) const
+{
+    return albedo(hit) / (4.0 * pi);
+}
+
+double Isotropic::pdf(const HitRecord& hit, const Vec3& wo, const Vec3& wi) const
+{
+    return 1.0 / (4.0 * pi);
+}
@@ -3,53 +3,186 @@
 #include "core/vec3.h"
 #include "materials/texture.h"
 
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
 #include <memory>
 
 struct HitRecord;
-struct Rng;
+class Sampler;
 
-class Ray;
+// Used by the integrator to apply separate bounce limits to each kind of scattering event
+enum class ScatterType
+{
+    Diffuse,
+    Specular,
+    Volume,
+};
 
+// Groups hits for wavefront shading, so that each batch runs one material's code
+enum class MaterialKind
+{
+    Lambertian,
+    Metal,
+    Dielectric,
+    LightSource,
+    Isotropic,
+    Other,
+    Count
+};
+
+struct BsdfSample
+{
+    Vec3 wi;            // Unit length, pointing away from the surface
+    Vec3 f;             // BSDF times |cos(theta_i)|
+    double pdf;         // Solid angle pdf, or the probability of picking the lobe when delta is set
+    ScatterType type;
+    bool delta;         // Discrete direction that can't be found by light sampling
+};
+
+// Spread of the ray cone leaving a scattering event. Delta lobes carry the incoming cone on (curvature is ignored), any
+// other lobe spreads at least as wide as the solid angle one of its samples stands for, 1 / pdf.
+inline double scatteredConeSpread(double spread, const BsdfSample& sample)
+{
+    return sample.delta ? spread : std::max(spread, 1.0 / std::sqrt(sample.pdf));
+}
+
+// All directions are unit length and point away from the surface, so wo is the negated incoming ray direction. eval()
+// and pdf() are zero for delta lobes.
 class IMaterial
 {
 public:
     virtual ~IMaterial() {}
 
-    virtual bool scatter(Rng& rng, const Ray& in, const HitRecord& hit, Vec3& attenuation, Ray& scattered) const = 0;
+    // Picks the scattered direction with the two numbers u0 and u1, returns false when the material doesn't scatter
+    virtual bool sample(double u0, double u1, const HitRecord& hit, const Vec3& wo, BsdfSample& sample) const = 0;
+    virtual Vec3 eval(const HitRecord& hit, const Vec3& wo, const Vec3& wi) const { return Vec3(0, 0, 0); }
+    virtual double pdf(const HitRecord& hit, const Vec3& wo, const Vec3& wi) const { return 0.0; }
+
+    // Draws the two numbers from the sampler's current dimension
+    bool sample(Sampler& sampler, const HitRecord& hit, const Vec3& wo, BsdfSample& sample) const;
+
+    // The same calls for the hits of count paths on this material at once, so that shading a batch costs one virtual
+    // call rather than one per hit. Hit k is hits[paths[k]], reached along directions[paths[k]], and its results go to
+    // element k. sampleBatch() takes its two numbers from u[2k] and u[2k + 1] and flags the hits that scatter.
+    virtual void emittedBatch(const HitRecord* hits, const uint32_t* paths, uint32_t count, Vec3* emitted) const;
+    virtual void sampleBatch(const HitRecord* hits, const Vec3* directions, const uint32_t* paths, uint32_t count, const double* u,
+                             BsdfSample* samples, uint8_t* scattered) const;
+    virtual void evalBatch(const HitRecord* hits, const Vec3* directions, const uint32_t* paths, const Vec3* wis, uint32_t count,
+                           Vec3* f, double* pdfs) const;
+
     virtual Vec3 albedo(const HitRecord& hit) const = 0;
+
+    // Texture albedo() samples when the hit has no albedo yet, integrators look it up for many hits at once
+    virtual const ITexture* albedoTexture() const { return nullptr; }
+
     virtual Vec3 emitted(const HitRecord& hit) const { return Vec3(0, 0, 0); }
+
+    // How far apart the directions sample() returns can land, from 0 when they're all delta (or it never scatters) to 1
+    // for a diffuse lobe. Integrators use it to decide how many paths are worth continuing from one hit.
+    virtual double scatterSpread() const { return 1.0; }
+
+    virtual MaterialKind kind() const { return MaterialKind::Other; }
+
+protected:
+    // The albedo kept on the hit, sampled from texture the first time the hit is asked for it
+    static const Vec3& cachedAlbedo(const HitRecord& hit, const ITexture& texture)
+    {
+        if (!hit.hasAlbedo)
+        {
+            hit.albedo = texture.sample(hit);
+            hit.hasAlbedo = true;
+        }
+
+        return hit.albedo;
+    }
 };
 
-class Lambertian : public IMaterial
+// Implements IMaterial's batched calls with loops over Material's own functions, which are called directly rather than
+// through the vtable, so they can be inlined into the loop
+template <typename Material>
+class BatchedMaterial : public IMaterial
+{
+public:
+    void emittedBatch(const HitRecord* hits, const uint32_t* paths, uint32_t count, Vec3* emitted) const override
+    {
+        const Material& material = static_cast<const Material&>(*this);
+
+        for (uint32_t k = 0; k < count; ++k)
+        {
+            emitted[k] = material.Material::emitted(hits[paths[k]]);
+        }
+    }
+
+    void sampleBatch(const HitRecord* hits, const Vec3* directions, const uint32_t* paths, uint32_t count, const double* u,
+                     BsdfSample* samples, uint8_t* scattered) const override
+    {
+        const Material& material = static_cast<const Material&>(*this);
+
+        for (uint32_t k = 0; k < count; ++k)
+        {
+            uint32_t i = paths[k];
+            scattered[k] = material.Material::sample(u[2 * k], u[2 * k + 1], hits[i], -directions[i], samples[k]);
+        }
+    }
+
+    void evalBatch(const HitRecord* hits, const Vec3* directions, const uint32_t* paths, const Vec3* wis, uint32_t count,
+                   Vec3* f, double* pdfs) const override
+    {
+        const Material& material = static_cast<const Material&>(*this);
+
+        for (uint32_t k = 0; k < count; ++k)
+        {
+            uint32_t i = paths[k];
+            f[k] = material.Material::eval(hits[i], -directions[i], wis[k]);
+            pdfs[k] = material.Material::pdf(hits[i], -directions[i], wis[k]);
+        }
+    }
+};
+
+class Lambertian final : public BatchedMaterial<Lambertian>
 {
 public:
     Lambertian() = default;
     Lambertian(const Vec3& color) : albedo_(std::make_shared<SolidColor>(color)) {}
     Lambertian(std::shared_ptr<ITexture> albedo) : albedo_(albedo) {}
 
-    bool scatter(Rng& rng, const Ray& in, const HitRecord& hit, Vec3& attenuation, Ray& scattered) const override;
-    Vec3 albedo(const HitRecord& hit) const override { return albedo_->sample(hit); }
+    bool sample(double u0, double u1, const HitRecord& hit, const Vec3& wo, BsdfSample& sample) const override;
+    Vec3 eval(const HitRecord& hit, const Vec3& wo, const Vec3& wi) const override;
+    double pdf(const HitRecord& hit, const Vec3& wo, const Vec3& wi) const override;
+    Vec3 albedo(const HitRecord& hit) const override { return cachedAlbedo(hit, *albedo_); }
+    const ITexture* albedoTexture() const override { return albedo_.get(); }
+    MaterialKind kind() const override { return MaterialKind::Lambertian; }
 
 private:
     std::shared_ptr<ITexture> albedo_;
 };
 
-class Metal : public IMaterial
+// GGX microfacet conductor with Schlick's Fresnel, roughness 0 is a perfect mirror
+class Metal final : public BatchedMaterial<Metal>
 {
 public:
     Metal() = default;
     Metal(const Vec3& color, double roughness) : albedo_(std::make_shared<SolidColor>(color)), roughness_(roughness) {}
     Metal(std::shared_ptr<ITexture> albedo, double roughness) : albedo_(albedo), roughness_(roughness) {}
 
-    bool scatter(Rng& rng, const Ray& in, const HitRecord& hit, Vec3& attenuation, Ray& scattered) const override;
-    Vec3 albedo(const HitRecord& hit) const override { return albedo_->sample(hit); }
+    bool sample(double u0, double u1, const HitRecord& hit, const Vec3& wo, BsdfSample& sample) const override;
+    Vec3 eval(const HitRecord& hit, const Vec3& wo, const Vec3& wi) const override;
+    double pdf(const HitRecord& hit, const Vec3& wo, const Vec3& wi) const override;
+    Vec3 albedo(const HitRecord& hit) const override { return cachedAlbedo(hit, *albedo_); }
+    const ITexture* albedoTexture() const override { return albedo_.get(); }
+    double scatterSpread() const override;
+    MaterialKind kind() const override { return MaterialKind::Metal; }
 
 private:
+    double alpha() const;
+
     std::shared_ptr<ITexture> albedo_;
     double roughness_;
 };
 
-class Dielectric : public IMaterial
+// Smooth dielectric, reflection or refraction is picked by the Fresnel term
+class Dielectric final : public BatchedMaterial<Dielectric>
 {
 public:
     Dielectric() = default;
@@ -57,37 +190,47 @@ public:
     Dielectric(const Vec3& color, double ior) : albedo_(std::make_shared<SolidColor>(color)), ior_(ior) {}
     Dielectric(double ior) : Dielectric(Vec3(1, 1, 1), ior) {}
 
-    bool scatter(Rng& rng, const Ray& in, const HitRecord& hit, Vec3& attenuation, Ray& scattered) const override;
-    Vec3 albedo(const HitRecord& hit) const override { return albedo_->sample(hit); }
+    bool sample(double u0, double u1, const HitRecord& hit, const Vec3& wo, BsdfSample& sample) const override;
+    Vec3 albedo(const HitRecord& hit) const override { return cachedAlbedo(hit, *albedo_); }
+    const ITexture* albedoTexture() const override { return albedo_.get(); }
+    double scatterSpread() const override { return 0.0; }
+    MaterialKind kind() const override { return MaterialKind::Dielectric; }
 
 private:
     std::shared_ptr<ITexture> albedo_;
     double ior_;
 };
 
-class LightSource : public IMaterial
+class LightSource final : public BatchedMaterial<LightSource>
 {
 public:
     LightSource() = default;
     LightSource(const Vec3& emitted) : emitted_(emitted) {}
 
-    bool scatter(Rng& rng, const Ray& in, const HitRecord& hit, Vec3& attenuation, Ray& scattered) const override { return false; }
+    bool sample(double u0, double u1, const HitRecord& hit, const Vec3& wo, BsdfSample& sample) const override { return false; }
     Vec3 albedo(const HitRecord& hit) const override { return Vec3(0, 0, 0); }
     Vec3 emitted(const HitRecord& hit) const override;
+    double scatterSpread() const override { return 0.0; }
+    MaterialKind kind() const override { return MaterialKind::LightSource; }
 
 private:
     Vec3 emitted_;
 };
 
-class Isotropic : public IMaterial
+// Isotropic phase function for participating media
+class Isotropic final : public BatchedMaterial<Isotropic>
 {
 public:
     Isotropic(const Vec3& color) : albedo_(std::make_shared<SolidColor>(color)) {}
     Isotropic(std::shared_ptr<ITexture> albedo) : albedo_(albedo) {}
 
-    bool scatter(Rng& rng, const Ray& in, const HitRecord& hit, Vec3& attenuation, Ray& scattered) const override;
-    Vec3 albedo(const HitRecord& hit) const override { return albedo_->sample(hit); }
+    bool sample(double u0, double u1, const HitRecord& hit, const Vec3& wo, BsdfSample& sample) const override;
+    Vec3 eval(const HitRecord& hit, const Vec3& wo, const Vec3& wi) const override;
+    double pdf(const HitRecord& hit, const Vec3& wo, const Vec3& wi) const override;
+    Vec3 albedo(const HitRecord& hit) const override { return cachedAlbedo(hit, *albedo_); }
+    const ITexture* albedoTexture() const override { return albedo_.get(); }
+    MaterialKind kind() const override { return MaterialKind::Isotropic; }
 
 public:
     std::shared_ptr<ITexture> albedo_;
-};
\ No newline at end of file
+};
@@ -3,6 +3,14 @@
 #include "core/rtiow.h"
 #include "stb_image.h"
 
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <filesystem>
+#include <functional>
+#include <iostream>
+#include <string>
+
 CheckerTexture::CheckerTexture(std::shared_ptr<ITexture> even, std::shared_ptr<ITexture> odd)
     : even_(even)
     , odd_(odd)
@@ -15,53 +23,315 @@ CheckerTexture::CheckerTexture(const Vec3& evenColor, const Vec3& oddColor)
 {
 }
 
+void ITexture::sampleBatch(const HitRecord* hits, const uint32_t* indices, uint32_t count, Vec3* colors, TextureScratch& scratch) const
+{
+    for (uint32_t k = 0; k < count; ++k)
+    {
+        colors[k] = sample(hits[indices[k]]);
+    }
+}
+
+// Parity of the checker cell p is in, whether sin(10 x) * sin(10 y) * sin(10 z) is negative. A sine is negative over the
+// odd half periods, so the sign of the product follows from which half period each factor is in without evaluating any
+// sines. Unlike the product, which is zero all over surfaces lying in the x, y or z = 0 planes, the half periods still
+// alternate along those surfaces.
+static bool checkerOdd(const Vec3& p)
+{
+    bool odd = false;
+
+    for (int a = 0; a < 3; ++a)
+    {
+        odd ^= (int64_t(std::floor(10 * p[a] / pi)) & 1) != 0;
+    }
+
+    return odd;
+}
+
 Vec3 CheckerTexture::sample(const HitRecord& hit) const
 {
-    // FIXME - this doesn't work for x/y/z constant zero
-    auto sines = std::sin(10 * hit.p.x) * std::sin(10 * hit.p.y) * std::sin(10 * hit.p.z);
-    auto texture = (sines < 0) ? odd_ : even_;
-    return texture->sample(hit);
+    const ITexture& texture = checkerOdd(hit.p) ? *odd_ : *even_;
+    return texture.sample(hit);
+}
+
+void CheckerTexture::sampleBatch(const HitRecord* hits, const uint32_t* indices, uint32_t count, Vec3* colors, TextureScratch& scratch) const
+{
+    // Indices into the batch of the hits on each side, then the hits themselves, even hits from the front and odd ones
+    // from the back
+    TextureScratch::Frame& frame = scratch.push();
+    frame.slots.resize(count);
+    frame.indices.resize(count);
+    frame.colors.resize(count);
+    uint32_t numEven = 0;
+    uint32_t firstOdd = count;
+
+    for (uint32_t k = 0; k < count; ++k)
+    {
+        uint32_t m = checkerOdd(hits[indices[k]].p) ? --firstOdd : numEven++;
+        frame.slots[m] = k;
+        frame.indices[m] = indices[k];
+    }
+
+    even_->sampleBatch(hits, frame.indices.data(), numEven, frame.colors.data(), scratch);
+    odd_->sampleBatch(hits, frame.indices.data() + firstOdd, count - firstOdd, frame.colors.data() + firstOdd, scratch);
+
+    for (uint32_t m = 0; m < count; ++m)
+    {
+        colors[frame.slots[m]] = frame.colors[m];
+    }
+
+    scratch.pop();
+}
+
+static const std::array<double, 256> LinearDecode = []()
+{
+    std::array<double, 256> result;
+    double c = 1.0 / 255.0;
+
+    for (int i = 0; i < 256; ++i)
+    {
+        result[i] = i * c;
+    }
+
+    return result;
+}();
+
+static double srgbToLinear(double c)
+{
+    return (c <= 0.04045) ? c / 12.92 : std::pow((c + 0.055) / 1.055, 2.4);
+}
+
+static double linearToSrgb(double c)
+{
+    return (c <= 0.0031308) ? c * 12.92 : 1.055 * std::pow(c, 1.0 / 2.4) - 0.055;
 }
 
-ImageTexture::ImageTexture(std::string_view path)
+static const std::array<double, 256> SrgbDecode = []()
 {
-    if (!load(path))
+    std::array<double, 256> result;
+
+    for (int i = 0; i < 256; ++i)
+    {
+        result[i] = srgbToLinear(i / 255.0);
+    }
+
+    return result;
+}();
+
+ImageTexture::ImageTexture(std::string_view path, bool srgb)
+{
+    if (!load(path, srgb))
     {
         exit(EXIT_FAILURE);
     }
 }
 
-bool ImageTexture::load(std::string_view path)
+// A tiled copy is current if it's at least as new as the image, or the image is gone
+static bool tiledCopyCurrent(const std::filesystem::path& image, const std::filesystem::path& tiled)
 {
-    stbi_uc* pixels = stbi_load(path.data(), &width_, &height_, nullptr, 3);
+    std::error_code error;
+    auto tiledTime = std::filesystem::last_write_time(tiled, error);
 
-    if (!pixels)
+    if (error)
     {
         return false;
     }
 
-    int size = width_ * height_;
-    data_.resize(size);
+    auto imageTime = std::filesystem::last_write_time(image, error);
+    return error || tiledTime >= imageTime;
+}
 
-    stbi_uc* src = pixels;
-    double c = 1.0 / 255.0;
+bool ImageTexture::load(std::string_view path, bool srgb)
+{
+    decode_ = srgb ? SrgbDecode.data() : LinearDecode.data();
+    cache_ = &TextureCache::get();
+    image_ = nullptr;
+    pages_.clear();
+    bool paged = cache_->enabled();
+    std::filesystem::path tiled;
 
-    for (int i = 0; i < size; ++i, src += 3)
+    if (paged)
     {
-        data_[i] = Vec3(src[0] * c, src[1] * c, src[2] * c);
+        // Named after the whole path so images with the same name don't collide, and mip levels are averaged in linear
+        // space so each decoding has its own copy
+        std::error_code error;
+        std::filesystem::path absolute = std::filesystem::absolute(path, error);
+        tiled = std::filesystem::path(cache_->directory()) /
+                (absolute.filename().string() + "." + std::to_string(std::hash<std::string>()(absolute.string())) + (srgb ? ".srgb.tiles" : ".tiles"));
+        image_ = cache_->find(tiled.string());
+
+        if (!image_ && tiledCopyCurrent(path, tiled))
+        {
+            image_ = cache_->open(tiled.string());
+        }
+
+        if (image_)
+        {
+            levels_ = image_->levels();
+            return true;
+        }
     }
 
+    int width;
+    int height;
+    stbi_uc* pixels = stbi_load(path.data(), &width, &height, nullptr, 3);
+
+    if (!pixels)
+    {
+        return false;
+    }
+
+    std::vector<TextureCache::Pixels> levels;
+    levels.push_back({ width, height, std::vector<uint8_t>(pixels, pixels + size_t(width) * height * 3) });
     stbi_image_free(pixels);
+
+    // Each level is a box filtered copy of the one above, averaged in linear space
+    while (width > 1 || height > 1)
+    {
+        const TextureCache::Pixels& parent = levels.back();
+        width = std::max(width / 2, 1);
+        height = std::max(height / 2, 1);
+        TextureCache::Pixels level{ width, height, std::vector<uint8_t>(size_t(width) * height * 3) };
+
+        for (int y = 0; y < height; ++y)
+        {
+            for (int x = 0; x < width; ++x)
+            {
+                for (int c = 0; c < 3; ++c)
+                {
+                    auto at = [&](int px, int py)
+                    {
+                        px = std::min(px, parent.width - 1);
+                        py = std::min(py, parent.height - 1);
+                        return decode_[parent.rgb[(px + size_t(py) * parent.width) * 3 + c]];
+                    };
+
+                    double value = clamp((at(2 * x, 2 * y) + at(2 * x + 1, 2 * y) + at(2 * x, 2 * y + 1) + at(2 * x + 1, 2 * y + 1)) * 0.25, 0.0, 1.0);
+                    level.rgb[(x + size_t(y) * width) * 3 + c] = uint8_t(std::lround((srgb ? linearToSrgb(value) : value) * 255.0));
+                }
+            }
+        }
+
+        levels.push_back(std::move(level));
+    }
+
+    if (paged)
+    {
+        std::error_code error;
+        std::filesystem::create_directories(tiled.parent_path(), error);
+
+        if (TextureCache::write(tiled.string(), levels))
+        {
+            image_ = cache_->open(tiled.string());
+        }
+
+        if (image_)
+        {
+            levels_ = image_->levels();
+            return true;
+        }
+
+        std::cerr << "Couldn't write a tiled copy of '" << path << "' to '" << tiled.parent_path().string() << "', loading it into memory.\n";
+    }
+
+    levels_ = TextureCache::tile(levels, pages_);
     return true;
 }
 
 Vec3 ImageTexture::sample(const HitRecord& hit) const
 {
+    const TextureCache::Level& top = levels_[0];
+
+    // The level has texels about as wide as the footprint along whichever texture axis it covers more texels of
+    double du = length(hit.dpdu);
+    double dv = length(hit.dpdv);
+
+    if (hit.footprint > 0.0 && du > 0.0 && dv > 0.0)
+    {
+        double texels = hit.footprint * std::max(top.width / du, top.height / dv);
+        return sample(hit.u, hit.v, std::log2(texels));
+    }
+
     double u = clamp(hit.u, 0.0, 1.0);
     double v = 1.0 - clamp(hit.v, 0.0, 1.0);
-    int x = int(u * (width_ - 1));
-    int y = int(v * (height_ - 1));
-    return data_[x + y * width_];
+    int x = int(u * (top.width - 1));
+    int y = int(v * (top.height - 1));
+    return texel(top, x, y);
+}
+
+Vec3 ImageTexture::sample(double u, double v, double lod) const
+{
+    u = clamp(u, 0.0, 1.0);
+    v = 1.0 - clamp(v, 0.0, 1.0);
+    lod = clamp(lod, 0.0, double(levels_.size() - 1));
+    size_t fine = size_t(lod);
+    double blend = lod - double(fine);
+
+    if (blend == 0.0)
+    {
+        return bilinear(levels_[fine], u, v);
+    }
+
+    return lerp(bilinear(levels_[fine], u, v), bilinear(levels_[fine + 1], u, v), blend);
+}
+
+Vec3 ImageTexture::texel(const TextureCache::Level& level, int x, int y) const
+{
+    x = std::clamp(x, 0, level.width - 1);
+    y = std::clamp(y, 0, level.height - 1);
+
+    if (!image_)
+    {
+        const uint8_t* texel = &pages_[TextureCache::texelOffset(level, x, y)];
+        return Vec3(decode_[texel[0]], decode_[texel[1]], decode_[texel[2]]);
+    }
+
+    uint8_t texel[3];
+    cache_->fetch(*image_, level, x, y, texel);
+    return Vec3(decode_[texel[0]], decode_[texel[1]], decode_[texel[2]]);
+}
+
+Vec3 ImageTexture::bilinear(const TextureCache::Level& level, double u, double v) const
+{
+    // Coordinates are at least -0.5, so truncating one past them floors
+    double x = u * level.width - 0.5;
+    double y = v * level.height - 0.5;
+    int x0 = int(x + 1.0) - 1;
+    int y0 = int(y + 1.0) - 1;
+    double fx = x - x0;
+    double fy = y - y0;
+
+    // Quads inside the level are gathered together, the ones past an edge clamp each texel
+    if (image_ && x0 >= 0 && y0 >= 0 && x0 + 1 < level.width && y0 + 1 < level.height)
+    {
+        uint8_t quad[12];
+        cache_->fetchQuad(*image_, level, x0, y0, quad);
+        auto decode = [this](const uint8_t* rgb) { return Vec3(decode_[rgb[0]], decode_[rgb[1]], decode_[rgb[2]]); };
+        return lerp(lerp(decode(quad), decode(quad + 3), fx), lerp(decode(quad + 6), decode(quad + 9), fx), fy);
+    }
+
+    return lerp(lerp(texel(level, x0, y0), texel(level, x0 + 1, y0), fx), lerp(texel(level, x0, y0 + 1), texel(level, x0 + 1, y0 + 1), fx), fy);
+}
+
+// Octaves of turbulence summed when nothing is known about the footprint, Perlin::turb()'s default
+constexpr int MaxNoiseOctaves = 7;
+
+// Octaves of turbulence finer than the footprint would only alias, the first has a lattice spacing of 1 / scale
+static int noiseOctaves(double scale, double footprint)
+{
+    if (footprint <= 0.0)
+    {
+        return MaxNoiseOctaves;
+    }
+
+    double spacing = 0.5 / scale;
+    int depth = 1;
+
+    for (; depth < MaxNoiseOctaves && spacing > footprint; spacing *= 0.5)
+    {
+        ++depth;
+    }
+
+    return depth;
 }
 
 NoiseTexture::NoiseTexture(double scale)
@@ -69,9 +339,93 @@ NoiseTexture::NoiseTexture(double scale)
 {
 }
 
+void NoiseTexture::bake(const Aabb& bounds, uint32_t resolution)
+{
+    Vec3 extents = bounds.extents();
+    double voxelSize = std::max({ extents.x, extents.y, extents.z }) / std::max(resolution, 1u);
+
+    int octaves = noiseOctaves(scale_, voxelSize);
+
+    // One voxel of margin on every side so lookups anywhere inside bounds interpolate between baked voxels
+    bakedOrigin_ = bounds.mins - Vec3(voxelSize, voxelSize, voxelSize);
+
+    for (int a = 0; a < 3; ++a)
+    {
+        bakedResolution_[a] = int(std::ceil(extents[a] / voxelSize)) + 2;
+    }
+
+    baked_.resize(size_t(bakedResolution_[0]) * bakedResolution_[1] * bakedResolution_[2]);
+    size_t v = 0;
+
+    for (int z = 0; z < bakedResolution_[2]; ++z)
+    {
+        for (int y = 0; y < bakedResolution_[1]; ++y)
+        {
+            for (int x = 0; x < bakedResolution_[0]; ++x, ++v)
+            {
+                Vec3 center = bakedOrigin_ + Vec3(x + 0.5, y + 0.5, z + 0.5) * voxelSize;
+                baked_[v] = float(noise_.turb(scale_ * center, octaves));
+            }
+        }
+    }
+
+    bakedBounds_ = bounds;
+    voxelSize_ = voxelSize;
+}
+
 Vec3 NoiseTexture::sample(const HitRecord& hit) const
 {
     //return Vec3(1, 1, 1) * 0.5 * (1 + noise_.turb(scale_ * hit.p));
     //return Vec3(1, 1, 1) * 0.5 * (1 + std::sin(scale_ * 10 * hit.p.z + 20 * noise_.turb(scale_ * hit.p)));
-    return Vec3(1, 1, 1) * 0.5 * (1 + std::sin(scale_ * 0.5 * hit.p.z + 2 * noise_.turb(scale_ * hit.p)));
+    return Vec3(1, 1, 1) * 0.5 * (1 + std::sin(scale_ * 0.5 * hit.p.z + 2 * turb(hit.p, hit.footprint)));
+}
+
+void NoiseTexture::sampleBatch(const HitRecord* hits, const uint32_t* indices, uint32_t count, Vec3* colors, TextureScratch& scratch) const
+{
+    TextureScratch::Frame& frame = scratch.push();
+    std::vector<double>& turbulence = frame.values;
+    turbulence.resize(count);
+
+    for (uint32_t k = 0; k < count; ++k)
+    {
+        turbulence[k] = turb(hits[indices[k]].p, hits[indices[k]].footprint);
+    }
+
+    for (uint32_t k = 0; k < count; ++k)
+    {
+        colors[k] = Vec3(1, 1, 1) * 0.5 * (1 + std::sin(scale_ * 0.5 * hits[indices[k]].p.z + 2 * turbulence[k]));
+    }
+
+    scratch.pop();
+}
+
+double NoiseTexture::turb(const Vec3& p, double footprint) const
+{
+    bool inside = !baked_.empty() && p.x >= bakedBounds_.mins.x && p.y >= bakedBounds_.mins.y && p.z >= bakedBounds_.mins.z &&
+                  p.x <= bakedBounds_.maxs.x && p.y <= bakedBounds_.maxs.y && p.z <= bakedBounds_.maxs.z;
+
+    // Finer footprints, or ones that aren't known, want octaves the grid doesn't hold
+    if (inside && footprint >= voxelSize_)
+    {
+        return bakedTurb(p);
+    }
+
+    return noise_.turb(scale_ * p, noiseOctaves(scale_, footprint));
+}
+
+double NoiseTexture::bakedTurb(const Vec3& p) const
+{
+    // Values sit at voxel centers, and the margin keeps all 8 neighbours of a point inside the bounds in the grid
+    Vec3 q = (p - bakedOrigin_) / voxelSize_ - Vec3(0.5, 0.5, 0.5);
+    Vec3 base(std::floor(q.x), std::floor(q.y), std::floor(q.z));
+    Vec3 f = q - base;
+    size_t rowStride = size_t(bakedResolution_[0]);
+    size_t sliceStride = rowStride * bakedResolution_[1];
+    const float* c = &baked_[(size_t(base.z) * bakedResolution_[1] + size_t(base.y)) * rowStride + size_t(base.x)];
+
+    double c00 = lerp(double(c[0]), double(c[1]), f.x);
+    double c10 = lerp(double(c[rowStride]), double(c[rowStride + 1]), f.x);
+    double c01 = lerp(double(c[sliceStride]), double(c[sliceStride + 1]), f.x);
+    double c11 = lerp(double(c[sliceStride + rowStride]), double(c[sliceStride + rowStride + 1]), f.x);
+    return lerp(lerp(c00, c10, f.y), lerp(c01, c11, f.y), f.z);
 }
@@ -1,19 +1,57 @@
 #pragma once
 
+#include "core/aabb.h"
 #include "core/vec3.h"
 #include "core/hit_record.h"
 #include "core/perlin.h"
+#include "materials/texture_cache.h"
 
+#include <cstdint>
+#include <deque>
 #include <memory>
 #include <string_view>
 #include <vector>
 
+// Buffers textures work in while sampling a batch, kept by the caller so batches don't allocate. Each texture pushes a
+// frame for the batch and pops it when done, so textures nested inside it get frames of their own.
+class TextureScratch
+{
+public:
+    struct Frame
+    {
+        std::vector<uint32_t> slots;
+        std::vector<uint32_t> indices;
+        std::vector<Vec3> colors;
+        std::vector<double> values;
+    };
+
+    Frame& push()
+    {
+        if (depth_ == frames_.size())
+        {
+            frames_.emplace_back();
+        }
+
+        return frames_[depth_++];
+    }
+
+    void pop() { --depth_; }
+
+private:
+    std::deque<Frame> frames_;      // A deque so pushing doesn't move the frames below
+    size_t depth_{ 0 };
+};
+
 class ITexture
 {
 public:
     virtual ~ITexture() = default;
 
     virtual Vec3 sample(const HitRecord& hit) const = 0;
+
+    // Samples hits[indices[k]] into colors[k] for each k < count, the same as sample() would. Textures override it to
+    // share work between the hits of a batch.
+    virtual void sampleBatch(const HitRecord* hits, const uint32_t* indices, uint32_t count, Vec3* colors, TextureScratch& scratch) const;
 };
 
 class SolidColor : public ITexture
@@ -23,6 +61,14 @@ public:
 
     Vec3 sample(const HitRecord& hit) const override { return color_; }
 
+    void sampleBatch(const HitRecord* hits, const uint32_t* indices, uint32_t count, Vec3* colors, TextureScratch& scratch) const override
+    {
+        for (uint32_t k = 0; k < count; ++k)
+        {
+            colors[k] = color_;
+        }
+    }
+
 private:
     Vec3 color_;
 };
@@ -35,36 +81,75 @@ public:
 
     Vec3 sample(const HitRecord& hit) const override;
 
+    // Classifies the whole batch first, then samples each child once with the hits that land on it
+    void sampleBatch(const HitRecord* hits, const uint32_t* indices, uint32_t count, Vec3* colors, TextureScratch& scratch) const override;
+
 private:
     std::shared_ptr<ITexture> odd_;
     std::shared_ptr<ITexture> even_;
 };
 
+// 8 bit RGB texels with a full mip chain, stored in tiles. Images are loaded into memory unless TextureCache has a
+// budget, then they're paged in on demand: the first load of an image writes a tiled copy of it to the cache's
+// directory, later loads and other textures using the same image share it. Bytes decode to linear values through a
+// lookup table.
 class ImageTexture : public ITexture
 {
 public:
     ImageTexture() = default;
-    ImageTexture(std::string_view path);
+    ImageTexture(std::string_view path, bool srgb = false);
 
-    bool load(std::string_view path);
+    // srgb decodes texels from the sRGB transfer curve, otherwise the bytes are taken as linear
+    bool load(std::string_view path, bool srgb = false);
 
     Vec3 sample(const HitRecord& hit) const override;
 
+    // Trilinear lookup, lod is the mip level to sample (0 is full resolution) and fractional levels blend the two
+    // nearest ones
+    Vec3 sample(double u, double v, double lod) const;
+
 private:
-    int width_;
-    int height_;
-    std::vector<Vec3> data_;
+    // Coordinates past the edges are clamped
+    Vec3 texel(const TextureCache::Level& level, int x, int y) const;
+    Vec3 bilinear(const TextureCache::Level& level, double u, double v) const;
+
+    std::vector<TextureCache::Level> levels_;
+    std::vector<uint8_t> pages_;                // Texels laid out as TextureCache pages them, when not paged
+    const TextureCache::Image* image_{ nullptr };   // Set when paged
+    TextureCache* cache_{ nullptr };
+    const double* decode_{ nullptr };   // 256 entries
 };
 
+// Marble from octaves of Perlin turbulence. Turbulence is evaluated exactly at each hit unless bake() has stored it in a
+// grid, then hits inside the baked bounds with a footprint no smaller than a voxel are interpolated from the grid.
 class NoiseTexture : public ITexture
 {
 public:
     NoiseTexture() = default;
     NoiseTexture(double scale);
 
+    // Samples turbulence over bounds at the centers of resolution voxels along its longest axis, with the octaves a
+    // voxel can hold
+    void bake(const Aabb& bounds, uint32_t resolution);
+
     Vec3 sample(const HitRecord& hit) const override;
 
+    // Looks up turbulence for the whole batch before any of the sines
+    void sampleBatch(const HitRecord* hits, const uint32_t* indices, uint32_t count, Vec3* colors, TextureScratch& scratch) const override;
+
 public:
     Perlin noise_;
     double scale_{ 1.0 };
+
+private:
+    double turb(const Vec3& p, double footprint) const;
+
+    // Trilinear lookup in the baked grid, p has to be inside the baked bounds
+    double bakedTurb(const Vec3& p) const;
+
+    std::vector<float> baked_;          // Turbulence at voxel centers, x fastest
+    int bakedResolution_[3]{};
+    Vec3 bakedOrigin_;                  // Corner of the grid, a voxel outside the baked bounds
+    Aabb bakedBounds_;
+    double voxelSize_{ 0.0 };
 };
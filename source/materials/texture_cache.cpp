@@ -0,0 +1,507 @@
+#include "texture_cache.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <thread>
+
+#if defined(_WIN32)
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+constexpr size_t PageBytes = size_t(TextureCache::PageSize) * TextureCache::PageSize * 3;
+
+// The header is padded to this, and pages are multiples of it, so every page starts on a page of the mapping
+constexpr size_t HeaderBytes = 4096;
+
+// Reading one page of a mapping maps in the already cached pages in an aligned block this large around it (Linux's
+// default fault around size)
+constexpr size_t FaultAroundBytes = 64 << 10;
+
+// Paging is off until setBudget() is called
+constexpr size_t DefaultBudget = 0;
+
+// Tiled copies go in this subdirectory of the temp directory until setDirectory() is called
+constexpr const char* DefaultDirectory = "rtiow_tiles";
+
+// Fewest slots the pool is given, enough for a few bilinear lookups per thread
+constexpr uint32_t MinSlots = 64;
+
+constexpr char Magic[8] = { 'R', 'T', 'T', 'I', 'L', 'E', 'S', '1' };
+
+struct FileHeader
+{
+    char magic[8];
+    uint32_t numLevels;
+    uint32_t numPages;
+};
+
+static uint32_t statShard()
+{
+    static std::atomic<uint32_t> nextShard{ 0 };
+    thread_local uint32_t shard = nextShard++;
+    return shard;
+}
+
+TextureCache::Image::~Image()
+{
+    if (!mapping_)
+    {
+        return;
+    }
+
+#if defined(_WIN32)
+    UnmapViewOfFile(mapping_);
+#else
+    munmap(mapping_, mappingSize_);
+#endif
+}
+
+TextureCache& TextureCache::get()
+{
+    static TextureCache cache;
+    return cache;
+}
+
+// Reads and checks the header and level table of a tiled file, so a truncated or damaged file is never mapped
+static bool readHeader(const std::string& path, std::vector<TextureCache::Level>& levels, uint32_t& numPages)
+{
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+
+    if (!file)
+    {
+        return false;
+    }
+
+    uint64_t size = uint64_t(file.tellg());
+    std::vector<char> block(HeaderBytes);
+    FileHeader header;
+
+    if (size < HeaderBytes || !file.seekg(0).read(block.data(), block.size()))
+    {
+        std::cerr << "Tiled texture '" << path << "' is truncated.\n";
+        return false;
+    }
+
+    std::memcpy(&header, block.data(), sizeof(header));
+
+    if (std::memcmp(header.magic, Magic, sizeof(Magic)) != 0 || header.numLevels == 0 ||
+        header.numLevels > (HeaderBytes - sizeof(header)) / sizeof(TextureCache::Level) ||
+        size != HeaderBytes + uint64_t(header.numPages) * PageBytes)
+    {
+        std::cerr << "Tiled texture '" << path << "' is damaged.\n";
+        return false;
+    }
+
+    levels.resize(header.numLevels);
+    std::memcpy(levels.data(), block.data() + sizeof(header), header.numLevels * sizeof(TextureCache::Level));
+
+    // Every level's pages have to lie inside the file, or lookups would read past the mapping
+    for (const TextureCache::Level& level : levels)
+    {
+        uint64_t pagesY = (uint64_t(std::max(level.height, 0)) + TextureCache::PageSize - 1) / TextureCache::PageSize;
+
+        if (level.width <= 0 || level.height <= 0 || uint64_t(level.pagesX) != (uint64_t(level.width) + TextureCache::PageSize - 1) / TextureCache::PageSize ||
+            level.firstPage + uint64_t(level.pagesX) * pagesY > header.numPages)
+        {
+            std::cerr << "Tiled texture '" << path << "' is damaged.\n";
+            return false;
+        }
+    }
+
+    numPages = header.numPages;
+    return true;
+}
+
+TextureCache::TextureCache()
+    : budget_(DefaultBudget)
+    , directory_((std::filesystem::temp_directory_path() / DefaultDirectory).string())
+{
+}
+
+void TextureCache::setBudget(size_t bytes)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    budget_ = bytes;
+
+    if (usedSlots_ == 0)
+    {
+        slots_.reset();
+        pool_.reset();
+        numSlots_ = 0;
+    }
+}
+
+bool TextureCache::enabled() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return budget_ > 0;
+}
+
+void TextureCache::setDirectory(const std::string& directory)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    directory_ = directory;
+}
+
+std::string TextureCache::directory() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return directory_;
+}
+
+const TextureCache::Image* TextureCache::find(const std::string& path) const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = images_.find(path);
+    return (it != images_.end()) ? it->second.get() : nullptr;
+}
+
+const TextureCache::Image* TextureCache::open(const std::string& path)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = images_.find(path);
+
+    if (it != images_.end())
+    {
+        return it->second.get();
+    }
+
+    auto image = std::make_unique<Image>();
+    uint32_t numPages;
+
+    if (!readHeader(path, image->levels_, numPages))
+    {
+        return nullptr;
+    }
+
+#if defined(_WIN32)
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+
+    if (file == INVALID_HANDLE_VALUE)
+    {
+        return nullptr;
+    }
+
+    LARGE_INTEGER size;
+    GetFileSizeEx(file, &size);
+    HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    image->mapping_ = mapping ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+    image->mappingSize_ = size_t(size.QuadPart);
+
+    // The view keeps the file mapped after the handles are closed
+    if (mapping)
+    {
+        CloseHandle(mapping);
+    }
+
+    CloseHandle(file);
+
+    if (!image->mapping_)
+    {
+        return nullptr;
+    }
+#else
+    int file = ::open(path.c_str(), O_RDONLY);
+
+    if (file < 0)
+    {
+        return nullptr;
+    }
+
+    struct stat info;
+    fstat(file, &info);
+    image->mappingSize_ = size_t(info.st_size);
+    void* mapping = mmap(nullptr, image->mappingSize_, PROT_READ, MAP_PRIVATE, file, 0);
+    close(file);
+
+    if (mapping == MAP_FAILED)
+    {
+        return nullptr;
+    }
+
+    // Pages are read in whatever order lookups ask for them, reading ahead would only add to what's resident
+    madvise(mapping, image->mappingSize_, MADV_RANDOM);
+    image->mapping_ = mapping;
+#endif
+
+    // The file could have been replaced since its header was read
+    if (image->mappingSize_ != HeaderBytes + size_t(numPages) * PageBytes)
+    {
+        std::cerr << "Tiled texture '" << path << "' changed while it was opened.\n";
+        return nullptr;
+    }
+
+    image->numPages_ = numPages;
+    image->pages_ = static_cast<const uint8_t*>(image->mapping_) + HeaderBytes;
+    image->slots_ = std::make_unique<std::atomic<uint32_t>[]>(numPages);
+
+    for (uint32_t page = 0; page < numPages; ++page)
+    {
+        image->slots_[page].store(NoSlot, std::memory_order_relaxed);
+    }
+
+    image->id_ = uint32_t(imagesById_.size());
+    imagesById_.push_back(image.get());
+    return images_.emplace(path, std::move(image)).first->second.get();
+}
+
+std::vector<TextureCache::Level> TextureCache::tile(const std::vector<Pixels>& levels, std::vector<uint8_t>& pages)
+{
+    std::vector<Level> table;
+    uint32_t numPages = 0;
+
+    for (const Pixels& pixels : levels)
+    {
+        int pagesX = (pixels.width + PageSize - 1) / PageSize;
+        int pagesY = (pixels.height + PageSize - 1) / PageSize;
+        table.push_back({ pixels.width, pixels.height, pagesX, numPages });
+        numPages += uint32_t(pagesX * pagesY);
+    }
+
+    // Texels past the levels' edges are left zero, lookups clamp before reaching them
+    pages.assign(size_t(numPages) * PageBytes, 0);
+
+    for (size_t i = 0; i < levels.size(); ++i)
+    {
+        const Pixels& pixels = levels[i];
+        const Level& level = table[i];
+
+        for (int y = 0; y < level.height; ++y)
+        {
+            for (int x = 0; x < level.width; ++x)
+            {
+                std::memcpy(&pages[texelOffset(level, x, y)], &pixels.rgb[(size_t(y) * level.width + x) * 3], 3);
+            }
+        }
+    }
+
+    return table;
+}
+
+bool TextureCache::write(const std::string& path, const std::vector<Pixels>& levels)
+{
+    std::vector<uint8_t> pages;
+    std::vector<Level> table = tile(levels, pages);
+
+    FileHeader header;
+    std::memcpy(header.magic, Magic, sizeof(Magic));
+    header.numLevels = uint32_t(table.size());
+    header.numPages = uint32_t(pages.size() / PageBytes);
+
+    if (sizeof(header) + table.size() * sizeof(Level) > HeaderBytes)
+    {
+        return false;
+    }
+
+    // Unique to this thread of this run, so concurrent writers of the same image don't share a temporary
+    size_t unique = std::hash<std::thread::id>()(std::this_thread::get_id()) ^
+        size_t(std::chrono::high_resolution_clock::now().time_since_epoch().count());
+    std::string temporary = path + "." + std::to_string(unique) + ".tmp";
+    std::error_code error;
+
+    {
+        std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+
+        if (!file)
+        {
+            return false;
+        }
+
+        std::vector<char> block(HeaderBytes, 0);
+        std::memcpy(block.data(), &header, sizeof(header));
+        std::memcpy(block.data() + sizeof(header), table.data(), table.size() * sizeof(Level));
+        file.write(block.data(), block.size());
+        file.write(reinterpret_cast<const char*>(pages.data()), std::streamsize(pages.size()));
+
+        if (!file.flush())
+        {
+            file.close();
+            std::filesystem::remove(temporary, error);
+            return false;
+        }
+    }
+
+    std::filesystem::rename(temporary, path, error);
+
+    if (error)
+    {
+        std::filesystem::remove(temporary, error);
+        return false;
+    }
+
+    return true;
+}
+
+void TextureCache::fetch(const Image& image, const Level& level, int x, int y, uint8_t* rgb)
+{
+    uint32_t page = level.firstPage + uint32_t(y / PageSize) * level.pagesX + uint32_t(x / PageSize);
+    size_t offset = pageOffset(x % PageSize, y % PageSize);
+    fetch(image, page, &offset, 1, rgb);
+}
+
+void TextureCache::fetchQuad(const Image& image, const Level& level, int x, int y, uint8_t* rgb)
+{
+    int px = x % PageSize;
+    int py = y % PageSize;
+
+    if (px + 1 == PageSize || py + 1 == PageSize)
+    {
+        fetch(image, level, x, y, rgb);
+        fetch(image, level, x + 1, y, rgb + 3);
+        fetch(image, level, x, y + 1, rgb + 6);
+        fetch(image, level, x + 1, y + 1, rgb + 9);
+        return;
+    }
+
+    uint32_t page = level.firstPage + uint32_t(y / PageSize) * level.pagesX + uint32_t(x / PageSize);
+    size_t offsets[4] = { pageOffset(px, py), pageOffset(px + 1, py), pageOffset(px, py + 1), pageOffset(px + 1, py + 1) };
+    fetch(image, page, offsets, 4, rgb);
+}
+
+void TextureCache::fetch(const Image& image, uint32_t page, const size_t* offsets, uint32_t count, uint8_t* rgb)
+{
+    uint64_t key = (uint64_t(image.id_) << 32) | page;
+    Counters& counters = counters_[statShard() % StatShards];
+    bool missed = false;
+
+    for (;;)
+    {
+        uint32_t s = image.slots_[page].load(std::memory_order_acquire);
+
+        if (s != NoSlot)
+        {
+            Slot& slot = slots_[s];
+            uint32_t sequence = slot.sequence.load(std::memory_order_acquire);
+
+            if ((sequence & 1) == 0 && slot.key.load(std::memory_order_relaxed) == key)
+            {
+                for (uint32_t i = 0; i < count; ++i)
+                {
+                    const std::atomic<uint8_t>* texel = &pool_[s * PageBytes + offsets[i]];
+                    rgb[i * 3] = texel[0].load(std::memory_order_relaxed);
+                    rgb[i * 3 + 1] = texel[1].load(std::memory_order_relaxed);
+                    rgb[i * 3 + 2] = texel[2].load(std::memory_order_relaxed);
+                }
+
+                std::atomic_thread_fence(std::memory_order_acquire);
+
+                // The page wasn't replaced while it was read
+                if (slot.sequence.load(std::memory_order_relaxed) == sequence)
+                {
+                    slot.referenced.store(1, std::memory_order_relaxed);
+                    std::atomic<uint64_t>& lookups = missed ? counters.misses : counters.hits;
+                    lookups.store(lookups.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+                    return;
+                }
+            }
+        }
+
+        load(image, page);
+        missed = true;
+    }
+}
+
+void TextureCache::load(const Image& image, uint32_t page)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    uint64_t key = (uint64_t(image.id_) << 32) | page;
+    uint32_t resident = image.slots_[page].load(std::memory_order_relaxed);
+
+    // Another thread may have paged it in while this one waited
+    if (resident != NoSlot && slots_[resident].key.load(std::memory_order_relaxed) == key)
+    {
+        return;
+    }
+
+    if (!pool_)
+    {
+        numSlots_ = std::max(uint32_t(std::min(budget_ / PageBytes, size_t(UINT32_MAX - 1))), MinSlots);
+        slots_ = std::make_unique<Slot[]>(numSlots_);
+        pool_.reset(new std::atomic<uint8_t>[numSlots_ * PageBytes]);
+    }
+
+    uint32_t s;
+
+    if (usedSlots_ < numSlots_)
+    {
+        s = usedSlots_++;
+    }
+    else
+    {
+        // Clock: pages looked up since the hand last passed get another lap
+        while (slots_[hand_].referenced.exchange(0, std::memory_order_relaxed) != 0)
+        {
+            hand_ = (hand_ + 1) % numSlots_;
+        }
+
+        s = hand_;
+        hand_ = (hand_ + 1) % numSlots_;
+
+        uint64_t evicted = slots_[s].key.load(std::memory_order_relaxed);
+        imagesById_[evicted >> 32]->slots_[uint32_t(evicted)].store(NoSlot, std::memory_order_relaxed);
+        ++evictions_;
+    }
+
+    Slot& slot = slots_[s];
+    uint32_t sequence = slot.sequence.load(std::memory_order_relaxed);
+    slot.sequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    // Readers may still be reading the old page, they see the sequence change and retry
+    const uint8_t* source = image.pages_ + page * PageBytes;
+    std::atomic<uint8_t>* destination = &pool_[s * PageBytes];
+
+    for (size_t i = 0; i < PageBytes; ++i)
+    {
+        destination[i].store(source[i], std::memory_order_relaxed);
+    }
+    slot.key.store(key, std::memory_order_relaxed);
+    slot.referenced.store(1, std::memory_order_relaxed);
+    slot.sequence.store(sequence + 2, std::memory_order_release);
+    image.slots_[page].store(s, std::memory_order_release);
+
+    // The copy is all that's needed, so the mapped pages are handed back rather than left to count against the
+    // process, along with the neighbours the fault mapped around them. Windows trims clean mapped pages from the
+    // working set by itself.
+#if !defined(_WIN32)
+    uintptr_t base = uintptr_t(image.mapping_);
+    uintptr_t begin = std::max(uintptr_t(source) & ~uintptr_t(FaultAroundBytes - 1), base);
+    uintptr_t end = std::min((uintptr_t(source) + PageBytes + FaultAroundBytes - 1) & ~uintptr_t(FaultAroundBytes - 1), base + image.mappingSize_);
+    madvise(reinterpret_cast<void*>(begin), end - begin, MADV_DONTNEED);
+#endif
+}
+
+void TextureCache::printStats(std::ostream& out) const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    if (images_.empty())
+    {
+        return;
+    }
+
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+
+    for (const Counters& counters : counters_)
+    {
+        hits += counters.hits.load(std::memory_order_relaxed);
+        misses += counters.misses.load(std::memory_order_relaxed);
+    }
+
+    uint64_t lookups = hits + misses;
+    out << "Texture cache: " << images_.size() << " images, " << usedSlots_ << "/" << numSlots_ << " pages resident ("
+        << (usedSlots_ * PageBytes >> 10) << " KiB), " << lookups << " lookups, " << misses << " misses ("
+        << (lookups ? 100.0 * double(misses) / double(lookups) : 0.0) << "%), " << evictions_ << " evictions\n";
+}
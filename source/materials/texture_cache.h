@@ -0,0 +1,143 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Process-wide cache of 8 bit RGB images with their mip chains, read from tiled files that are memory mapped and paged
+// in on demand. Each level of a file is split into 64x64 texel pages, and each page into 8x8 texel tiles so texels
+// close in both directions share cache lines. Pages are copied out of the mapping into a pool of fixed size slots, the
+// mapped copy is released straight away, and when the pool is full the least recently used page (by the clock
+// approximation) makes room, so resident memory stays within the budget however much texture a scene references.
+// Lookups don't take a lock: each slot carries a sequence number that is odd while its page is being replaced, and a
+// reader that sees it change retries. The pool's bytes are atomics, so a read racing a replacement is only wasted.
+// Paging costs an indirection per lookup, so it's off (budget 0) unless the textures wouldn't fit in memory.
+class TextureCache
+{
+public:
+    // Width and height of a page, and of the tiles each page is stored in
+    static constexpr int PageSize = 64;
+    static constexpr int TileSize = 8;
+
+    struct Level
+    {
+        int width;
+        int height;
+        int pagesX;         // Pages along each row of the level
+        uint32_t firstPage; // Pages of the file before the level's first one
+    };
+
+    // Row major texels of one level, 3 bytes each
+    struct Pixels
+    {
+        int width;
+        int height;
+        std::vector<uint8_t> rgb;
+    };
+
+    class Image
+    {
+    public:
+        ~Image();
+
+        const std::vector<Level>& levels() const { return levels_; }
+
+    private:
+        friend class TextureCache;
+
+        uint32_t id_;
+        std::vector<Level> levels_;
+        uint32_t numPages_;
+        const uint8_t* pages_{ nullptr };           // Inside the mapping
+        void* mapping_{ nullptr };
+        size_t mappingSize_{ 0 };
+        std::unique_ptr<std::atomic<uint32_t>[]> slots_;  // Slot holding each page, or NoSlot
+    };
+
+    static TextureCache& get();
+
+    // Bytes of page slots, takes effect the next time the cache is empty, i.e. before anything is sampled. 0 turns
+    // paging off, images are then expected to be loaded whole.
+    void setBudget(size_t bytes);
+    bool enabled() const;
+
+    // Where tiled copies of images are kept
+    void setDirectory(const std::string& directory);
+    std::string directory() const;
+
+    // Maps the tiled file at path, every call with the same path shares one Image. nullptr if it can't be read.
+    const Image* open(const std::string& path);
+    const Image* find(const std::string& path) const;
+
+    // Writes the levels, full resolution first, as a tiled file. It's written under a temporary name and renamed into
+    // place, so other processes never open a partial file.
+    static bool write(const std::string& path, const std::vector<Pixels>& levels);
+
+    // Lays the levels out in pages as a tiled file stores them, for images kept in memory instead
+    static std::vector<Level> tile(const std::vector<Pixels>& levels, std::vector<uint8_t>& pages);
+
+    // Offset of texel (px, py) of a page from the start of the page
+    static size_t pageOffset(int px, int py)
+    {
+        return ((size_t(py / TileSize) * (PageSize / TileSize) + px / TileSize) * TileSize * TileSize + (py % TileSize) * TileSize + px % TileSize) * 3;
+    }
+
+    // Offset of texel (x, y) of a level from the start of the first page
+    static size_t texelOffset(const Level& level, int x, int y)
+    {
+        size_t page = level.firstPage + size_t(y / PageSize) * level.pagesX + size_t(x / PageSize);
+        return page * PageSize * PageSize * 3 + pageOffset(x % PageSize, y % PageSize);
+    }
+
+    // Copies texel (x, y) of a level of image into rgb, paging it in if it isn't resident
+    void fetch(const Image& image, const Level& level, int x, int y, uint8_t* rgb);
+
+    // Copies the 2x2 texels from (x, y) to (x + 1, y + 1) into rgb, row by row, all four with one lookup when they're
+    // on the same page. The quad must be inside the level.
+    void fetchQuad(const Image& image, const Level& level, int x, int y, uint8_t* rgb);
+
+    void printStats(std::ostream& out) const;
+
+private:
+    static constexpr uint32_t NoSlot = UINT32_MAX;
+    static constexpr uint32_t StatShards = 16;
+
+    struct Slot
+    {
+        std::atomic<uint32_t> sequence{ 0 };    // Odd while the slot's page is being replaced
+        std::atomic<uint64_t> key{ UINT64_MAX };// Image id in the high half, page in the low half
+        std::atomic<uint8_t> referenced{ 0 };   // Set by lookups, cleared as the clock hand passes
+    };
+
+    struct alignas(64) Counters
+    {
+        std::atomic<uint64_t> hits{};
+        std::atomic<uint64_t> misses{};     // Lookups that had to page in, or wait for another thread to
+    };
+
+    TextureCache();
+
+    // Copies count texels of page, at byte offsets from the start of the page, into rgb
+    void fetch(const Image& image, uint32_t page, const size_t* offsets, uint32_t count, uint8_t* rgb);
+    void load(const Image& image, uint32_t page);
+
+    mutable std::mutex mutex_;  // Held while opening images and paging in, never by lookups that hit
+    std::unordered_map<std::string, std::unique_ptr<Image>> images_;
+    std::vector<Image*> imagesById_;
+    size_t budget_;
+    std::string directory_;
+    std::unique_ptr<Slot[]> slots_;
+    std::unique_ptr<std::atomic<uint8_t>[]> pool_;  // Left uninitialised so only slots in use become resident
+    uint32_t numSlots_{ 0 };
+    uint32_t usedSlots_{ 0 };
+    uint32_t hand_{ 0 };
+    uint64_t evictions_{ 0 };
+    // Lookups are counted without read-modify-writes, each thread in its own shard, so counts are only approximate when
+    // more than StatShards threads sample textures
+    Counters counters_[StatShards];
+};
@@ -1,12 +1,15 @@
 #pragma once
 
 #include "shapes/hittable_list.h"
+#include "shapes/light_tree.h"
 #include "core/sky.h"
 #include "camera/camera.h"
 
 class Scene : public HittableList
 {
 public:
+    // Built by main from the scene's emitters once the scene is complete
+    LightTree lights;
     Camera::CreateInfo cameraCreateInfo;
     std::shared_ptr<Sky> sky;
     std::shared_ptr<Camera> camera;
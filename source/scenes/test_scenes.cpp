@@ -9,11 +9,15 @@
 #include "shapes/box.h"
 #include "shapes/camera_invisible.h"
 #include "shapes/constant_medium.h"
+#include "shapes/density.h"
 #include "shapes/flip_normals.h"
+#include "shapes/heterogeneous_medium.h"
 #include "shapes/sphere.h"
 #include "shapes/sphere_tree.h"
 #include "shapes/transform.h"
+#include "shapes/voxel_grid.h"
 
+#include <algorithm>
 #include <iostream>
 
 namespace scenes
@@ -57,7 +61,8 @@ struct CornellBoxData
     static constexpr Vec3 light = Vec3(18.4, 15.6, 8.0);
 };
 
-static Scene emptyCornellBox()
+// With lightFacesCeiling the light is turned over, so everything but the ceiling is lit indirectly
+static Scene emptyCornellBox(bool lightFacesCeiling = false)
 {
     Scene scene;
 
@@ -91,7 +96,14 @@ static Scene emptyCornellBox()
         CornellBoxData::xmin, green));
 
     // Light
-    scene.add(std::make_shared<FlipNormals>(std::make_shared<RectangleXZ>(213, 343, 227, 332, 549.5, light)));
+    if (lightFacesCeiling)
+    {
+        scene.add(std::make_shared<RectangleXZ>(213, 343, 227, 332, 500, light));
+    }
+    else
+    {
+        scene.add(std::make_shared<FlipNormals>(std::make_shared<RectangleXZ>(213, 343, 227, 332, 549.5, light)));
+    }
 
     // Camera
     scene.cameraCreateInfo.position = Vec3(278, 273, -800);
@@ -282,6 +294,25 @@ Scene cornellBox()
     return scene;
 }
 
+Scene indirectCornellBox()
+{
+    Scene scene = emptyCornellBox(true);
+
+    std::shared_ptr<IMaterial> white = std::make_shared<Lambertian>(Vec3(0.7, 0.7, 0.7));
+
+    // Tall block
+    constexpr Vec3 tallBoxDims = { 165, 330, 167 };
+    Mat4 xform = glm::translate(Vec3(380, 165, 400)) * glm::rotate(60.0, Vec3(0, 1, 0));
+    scene.add(std::make_shared<Transform>(xform, std::make_shared<Box>(tallBoxDims, white)));
+
+    // Short block
+    constexpr Vec3 shortBoxDims = { 167, 165, 165 };
+    xform = glm::translate(Vec3(200, 82.5, 280)) * glm::rotate(-60.0, Vec3(0, 1, 0));
+    scene.add(std::make_shared<Transform>(xform, std::make_shared<Box>(shortBoxDims, white)));
+
+    return scene;
+}
+
 Scene boxTest(std::string_view skyhdri)
 {
     Scene scene;
@@ -412,6 +443,49 @@ Scene smokeBoxes()
     return scene;
 }
 
+Scene noisySmoke()
+{
+    Scene scene = emptyCornellBox();
+
+    // A cloud of turbulent smoke filling most of the box
+    auto boundary = std::make_shared<Box>(Vec3(60, 0, 60), Vec3(495, 420, 495), nullptr);
+    auto density = std::make_shared<NoiseDensity>(0.03, 0.015);
+    scene.add(std::make_shared<HeterogeneousMedium>(boundary, density, Vec3(0.9, 0.9, 0.9)));
+
+    return scene;
+}
+
+Scene voxelCloud()
+{
+    Scene scene = emptyCornellBox();
+
+    // Perlin turbulence baked into a sparse grid, thresholded and faded out towards a ball so most bricks stay empty
+    constexpr Vec3 center = { 278, 230, 278 };
+    constexpr double radius = 200;
+    constexpr double threshold = 0.15;
+    NoiseDensity noise(1.0, 0.02);
+
+    VoxelGrid::CreateInfo gridCreateInfo{};
+    gridCreateInfo.mins = Vec3(5, 5, 5);
+    gridCreateInfo.voxelSize = 545.0 / 160.0;
+    gridCreateInfo.resolution[0] = 160;
+    gridCreateInfo.resolution[1] = 160;
+    gridCreateInfo.resolution[2] = 160;
+    auto grid = std::make_shared<VoxelGrid>(gridCreateInfo);
+
+    grid->fill([&](const Vec3& p)
+    {
+        double falloff = 1.0 - length(p - center) / radius;
+        return (falloff > 0.0) ? 0.5 * falloff * std::max(noise.value(p) - threshold, 0.0) / (1.0 - threshold) : 0.0;
+    });
+
+    Aabb bounds = grid->bounds();
+    auto boundary = std::make_shared<Box>(bounds.mins, bounds.maxs, nullptr);
+    scene.add(std::make_shared<HeterogeneousMedium>(boundary, grid, Vec3(0.9, 0.9, 0.9)));
+
+    return scene;
+}
+
 Scene theNextWeek()
 {
     Scene scene;
@@ -461,7 +535,9 @@ Scene theNextWeek()
     auto emat = std::make_shared<Lambertian>(std::make_shared<ImageTexture>(R"(R:\assets\textures\earthmap.png)"));
     scene.add(std::make_shared<Sphere>(Vec3(400, 200, 400), 100, emat));
 
+    // Baked at about the footprint of a pixel at the default resolution, finer footprints still evaluate it exactly
     auto pertext = std::make_shared<NoiseTexture>(0.05);
+    pertext->bake(Aabb(Vec3(140, 200, 220), Vec3(300, 360, 380)), 128);
     scene.add(std::make_shared<Sphere>(Vec3(220, 280, 300), 80, std::make_shared<Lambertian>(pertext)));
 
     HittableList boxes2;
@@ -487,4 +563,59 @@ Scene theNextWeek()
 
     return scene;
 }
+Scene manyLights()
+{
+    Scene scene;
+    Rng rng(7081990);
+
+    auto grey = std::make_shared<Lambertian>(Vec3(0.5, 0.5, 0.5));
+    scene.add(std::make_shared<RectangleXZ>(-60, 60, -60, 60, 0, grey));
+
+    // A grid of small coloured lamps between pillars, inside the BVH like everything else. The light tree finds them by
+    // their material.
+    HittableList objects;
+    constexpr int lampsPerSide = 48;
+    constexpr double spacing = 100.0 / lampsPerSide;
+
+    for (int i = 0; i < lampsPerSide; ++i)
+    {
+        for (int j = 0; j < lampsPerSide; ++j)
+        {
+            double x = -50.0 + (i + rng(0.2, 0.8)) * spacing;
+            double z = -50.0 + (j + rng(0.2, 0.8)) * spacing;
+            double y = rng(0.3, 2.0);
+            auto light = std::make_shared<LightSource>(Vec3(rng(), rng(), rng()) * rng(2.0, 20.0));
+            std::shared_ptr<IHittable> lamp;
+
+            if ((i + j) & 1)
+            {
+                lamp = std::make_shared<Sphere>(Vec3(x, y, z), 0.15, light);
+            }
+            else
+            {
+                lamp = std::make_shared<FlipNormals>(std::make_shared<RectangleXZ>(x - 0.3, x + 0.3, z - 0.3, z + 0.3, y, light));
+            }
+
+            objects.add(lamp);
+
+            if (rng() < 0.25)
+            {
+                Vec3 mins(x + spacing * 0.3, 0.0, z + spacing * 0.3);
+                objects.add(std::make_shared<Box>(mins, mins + Vec3(0.6, rng(1.0, 4.0), 0.6), grey));
+            }
+        }
+    }
+
+    scene.add(std::make_shared<AabbTreeNode>(objects, 0, 1, rng));
+
+    scene.sky = std::make_shared<ConstantColorSky>(Vec3(0, 0, 0));
+    scene.cameraCreateInfo.position = Vec3(0, 12, -40);
+    scene.cameraCreateInfo.target = Vec3(0, 0, 0);
+    scene.cameraCreateInfo.vup = Vec3(0, 1, 0);
+    scene.cameraCreateInfo.fovy = degToRad(50.0);
+    scene.cameraCreateInfo.focalDistance = 40.0;
+    scene.cameraCreateInfo.aperature = 0.0;
+
+    return scene;
+}
 }
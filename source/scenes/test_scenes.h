@@ -15,6 +15,10 @@ Scene animTest(std::string_view skyhdri);
 Scene texturedSphere(std::string_view skyhdri);
 Scene noiseTextureTest();
 Scene smokeBoxes();
+Scene noisySmoke();
+Scene voxelCloud();
 Scene theNextWeek();
+Scene indirectCornellBox();
+Scene manyLights();
 
 }
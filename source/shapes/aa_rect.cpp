@@ -1,9 +1,28 @@
 #include "aa_rect.h"
 
 #include "core/hit_record.h"
+#include "core/sampler.h"
+#include "materials/material.h"
+
+#include <limits>
 
 constexpr double BboxThickness = 0.001;
 
+// Converts the area pdf of a uniformly sampled rectangle to a solid angle pdf at the ray origin
+static double rectanglePdf(const IHittable& rect, const Vec3& origin, const Vec3& direction, double time, double area)
+{
+    HitRecord hit{};
+
+    if (!rect.hit(Ray(origin, direction, time, false, nullptr), 0.001, std::numeric_limits<double>::infinity(), hit))
+    {
+        return 0.0;
+    }
+
+    double distanceSquared = hit.t * hit.t * length2(direction);
+    double cosine = std::abs(dot(direction, hit.n)) / length(direction);
+    return distanceSquared / (cosine * area);
+}
+
 bool RectangleXY::hit(const Ray& r, double tMin, double tMax, HitRecord& hit) const
 {
     if (std::abs(r.direction.z) <= 0.0)
@@ -31,6 +50,8 @@ bool RectangleXY::hit(const Ray& r, double tMin, double tMax, HitRecord& hit) co
     hit.p = p;
     hit.u = (p.x - x0) / (x1 - x0);
     hit.v = (p.y - y0) / (y1 - y0);
+    hit.dpdu = Vec3(x1 - x0, 0, 0);
+    hit.dpdv = Vec3(0, y1 - y0, 0);
 
     return true;
 }
@@ -42,6 +63,38 @@ bool RectangleXY::boundingBox(double startTime, double endTime, Aabb& bbox) cons
     return true;
 }
 
+double RectangleXY::pdfValue(const Vec3& origin, const Vec3& direction, double time) const
+{
+    return rectanglePdf(*this, origin, direction, time, (x1 - x0) * (y1 - y0));
+}
+
+Vec3 RectangleXY::sampleDirection(Sampler& sampler, const Vec3& origin, double time) const
+{
+    return normalize(Vec3(sampler(x0, x1), sampler(y0, y1), k) - origin);
+}
+
+double RectangleXY::samplePoint(Sampler& sampler, double time, HitRecord& hit) const
+{
+    hit.p = Vec3(sampler(x0, x1), sampler(y0, y1), k);
+    hit.n = Vec3(0, 0, 1);
+    hit.frontFace = true;
+    hit.material = material.get();
+    hit.u = (hit.p.x - x0) / (x1 - x0);
+    hit.v = (hit.p.y - y0) / (y1 - y0);
+    return (x1 - x0) * (y1 - y0);
+}
+
+void RectangleXY::normalBounds(Vec3& axis, double& cosTheta) const
+{
+    axis = Vec3(0, 0, 1);
+    cosTheta = 1.0;
+}
+
+bool RectangleXY::emitter() const
+{
+    return material && material->kind() == MaterialKind::LightSource;
+}
+
 bool RectangleXZ::hit(const Ray& r, double tMin, double tMax, HitRecord& hit) const
 {
     if (std::abs(r.direction.y) <= 0.0)
@@ -69,6 +122,8 @@ bool RectangleXZ::hit(const Ray& r, double tMin, double tMax, HitRecord& hit) co
     hit.p = p;
     hit.u = (p.x - x0) / (x1 - x0);
     hit.v = (p.z - z1) / (z0 - z1);
+    hit.dpdu = Vec3(x1 - x0, 0, 0);
+    hit.dpdv = Vec3(0, 0, z0 - z1);
 
     return true;
 }
@@ -80,6 +135,38 @@ bool RectangleXZ::boundingBox(double startTime, double endTime, Aabb& bbox) cons
     return true;
 }
 
+double RectangleXZ::pdfValue(const Vec3& origin, const Vec3& direction, double time) const
+{
+    return rectanglePdf(*this, origin, direction, time, (x1 - x0) * (z1 - z0));
+}
+
+Vec3 RectangleXZ::sampleDirection(Sampler& sampler, const Vec3& origin, double time) const
+{
+    return normalize(Vec3(sampler(x0, x1), k, sampler(z0, z1)) - origin);
+}
+
+double RectangleXZ::samplePoint(Sampler& sampler, double time, HitRecord& hit) const
+{
+    hit.p = Vec3(sampler(x0, x1), k, sampler(z0, z1));
+    hit.n = Vec3(0, 1, 0);
+    hit.frontFace = true;
+    hit.material = material.get();
+    hit.u = (hit.p.x - x0) / (x1 - x0);
+    hit.v = (hit.p.z - z1) / (z0 - z1);
+    return (x1 - x0) * (z1 - z0);
+}
+
+void RectangleXZ::normalBounds(Vec3& axis, double& cosTheta) const
+{
+    axis = Vec3(0, 1, 0);
+    cosTheta = 1.0;
+}
+
+bool RectangleXZ::emitter() const
+{
+    return material && material->kind() == MaterialKind::LightSource;
+}
+
 bool RectangleYZ::hit(const Ray& r, double tMin, double tMax, HitRecord& hit) const
 {
     if (std::abs(r.direction.x) <= 0.0)
@@ -107,6 +194,8 @@ bool RectangleYZ::hit(const Ray& r, double tMin, double tMax, HitRecord& hit) co
     hit.p = p;
     hit.u = (p.z - z1) / (z0 - z1);
     hit.v = (p.y - y0) / (y1 - y0);
+    hit.dpdu = Vec3(0, 0, z0 - z1);
+    hit.dpdv = Vec3(0, y1 - y0, 0);
 
     return true;
 }
@@ -117,3 +206,35 @@ bool RectangleYZ::boundingBox(double startTime, double endTime, Aabb& bbox) cons
     bbox.maxs = Vec3(k + BboxThickness * 0.5, y1, z1);
     return true;
 }
+
+double RectangleYZ::pdfValue(const Vec3& origin, const Vec3& direction, double time) const
+{
+    return rectanglePdf(*this, origin, direction, time, (y1 - y0) * (z1 - z0));
+}
+
+Vec3 RectangleYZ::sampleDirection(Sampler& sampler, const Vec3& origin, double time) const
+{
+    return normalize(Vec3(k, sampler(y0, y1), sampler(z0, z1)) - origin);
+}
+
+double RectangleYZ::samplePoint(Sampler& sampler, double time, HitRecord& hit) const
+{
+    hit.p = Vec3(k, sampler(y0, y1), sampler(z0, z1));
+    hit.n = Vec3(1, 0, 0);
+    hit.frontFace = true;
+    hit.material = material.get();
+    hit.u = (hit.p.z - z1) / (z0 - z1);
+    hit.v = (hit.p.y - y0) / (y1 - y0);
+    return (y1 - y0) * (z1 - z0);
+}
+
+void RectangleYZ::normalBounds(Vec3& axis, double& cosTheta) const
+{
+    axis = Vec3(1, 0, 0);
+    cosTheta = 1.0;
+}
+
+bool RectangleYZ::emitter() const
+{
+    return material && material->kind() == MaterialKind::LightSource;
+}
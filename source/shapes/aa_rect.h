@@ -23,6 +23,11 @@ public:
 
     bool hit(const Ray& r, double tMin, double tMax, HitRecord& hit) const override;
     bool boundingBox(double startTime, double endTime, Aabb& bbox) const override;
+    double pdfValue(const Vec3& origin, const Vec3& direction, double time) const override;
+    Vec3 sampleDirection(Sampler& sampler, const Vec3& origin, double time) const override;
+    double samplePoint(Sampler& sampler, double time, HitRecord& hit) const override;
+    void normalBounds(Vec3& axis, double& cosTheta) const override;
+    bool emitter() const override;
 };
 
 class RectangleXZ : public IHittable
@@ -44,6 +49,11 @@ public:
 
     bool hit(const Ray& r, double tMin, double tMax, HitRecord& hit) const override;
     bool boundingBox(double startTime, double endTime, Aabb& bbox) const override;
+    double pdfValue(const Vec3& origin, const Vec3& direction, double time) const override;
+    Vec3 sampleDirection(Sampler& sampler, const Vec3& origin, double time) const override;
+    double samplePoint(Sampler& sampler, double time, HitRecord& hit) const override;
+    void normalBounds(Vec3& axis, double& cosTheta) const override;
+    bool emitter() const override;
 };
 
 class RectangleYZ : public IHittable
@@ -65,4 +75,9 @@ public:
 
     bool hit(const Ray& r, double tMin, double tMax, HitRecord& hit) const override;
     bool boundingBox(double startTime, double endTime, Aabb& bbox) const override;
+    double pdfValue(const Vec3& origin, const Vec3& direction, double time) const override;
+    Vec3 sampleDirection(Sampler& sampler, const Vec3& origin, double time) const override;
+    double samplePoint(Sampler& sampler, double time, HitRecord& hit) const override;
+    void normalBounds(Vec3& axis, double& cosTheta) const override;
+    bool emitter() const override;
 };
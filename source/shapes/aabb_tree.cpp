@@ -1,10 +1,12 @@
 #include "aabb_tree.h"
 
 #include "core/hit_record.h"
+#include "core/ray_packet.h"
 #include "shapes/hittable_list.h"
 
 #include <algorithm>
 #include <iostream>
+#include <limits>
 
 AabbTreeNode::AabbTreeNode(const HittableList& list, double timeStart, double timeEnd, Rng& rng)
     : AabbTreeNode(list.objects(), 0, list.objects().size(), timeStart, timeEnd, rng)
@@ -81,13 +83,110 @@ bool AabbTreeNode::hit(const Ray& r, double tMin, double tMax, HitRecord& hitRec
         return false;
     }
 
+    return hitChildren(r, tMin, tMax, hitRecord);
+}
+
+uint32_t AabbTreeNode::hitPacket(const RayPacket& packet, uint32_t active, double tMin, const double* tMax, HitRecord* hits) const
+{
+    double tMaxLo = std::numeric_limits<double>::infinity();
+    double tMaxHi = -std::numeric_limits<double>::infinity();
+
+    for (uint32_t i = 0; i < packet.size; ++i)
+    {
+        if (active & (1u << i))
+        {
+            tMaxLo = std::min(tMaxLo, tMax[i]);
+            tMaxHi = std::max(tMaxHi, tMax[i]);
+        }
+    }
+
+    uint32_t entering = active;
+
+    switch (packet.overlap(bounds_, tMin, tMaxLo, tMaxHi))
+    {
+        case PacketOverlap::None:
+        {
+            return 0;
+        }
+        case PacketOverlap::Some:
+        {
+            entering = packet.hitMask(bounds_, active, tMin, tMax);
+            break;
+        }
+        case PacketOverlap::All:
+        {
+            break;
+        }
+    }
+
+    if (entering == 0)
+    {
+        return 0;
+    }
+
+    // Once the packet has diverged down to a single ray, the interval tests cost more than they save
+    if ((entering & (entering - 1)) == 0)
+    {
+        uint32_t i = 0;
+
+        while (!(entering & (1u << i)))
+        {
+            ++i;
+        }
+
+        return hitChildren(packet.rays[i], tMin, tMax[i], hits[i]) ? entering : 0;
+    }
+
+    uint32_t hitLeft = left_->hitPacket(packet, entering, tMin, tMax, hits);
+    double rightMax[MaxPacketSize];
+
+    for (uint32_t i = 0; i < packet.size; ++i)
+    {
+        rightMax[i] = (hitLeft & (1u << i)) ? hits[i].t : tMax[i];
+    }
+
+    uint32_t hitRight = right_->hitPacket(packet, entering, tMin, rightMax, hits);
+    return hitLeft | hitRight;
+}
+
+bool AabbTreeNode::hitChildren(const Ray& r, double tMin, double tMax, HitRecord& hitRecord) const
+{
     bool hitLeft = left_->hit(r, tMin, tMax, hitRecord);
     bool hitRight = right_->hit(r, tMin, hitLeft ? hitRecord.t : tMax, hitRecord);
     return hitLeft || hitRight;
 }
 
+double AabbTreeNode::transmittance(const Ray& r, double tMin, double tMax) const
+{
+    if (!bounds_.hit(r, tMin, tMax))
+    {
+        return 1.0;
+    }
+
+    double result = left_->transmittance(r, tMin, tMax);
+
+    // Single object nodes point both children at it, its media must only be crossed once
+    if (right_ != left_ && result > 0.0)
+    {
+        result *= right_->transmittance(r, tMin, tMax);
+    }
+
+    return result;
+}
+
 bool AabbTreeNode::boundingBox(double timeStart, double timeEnd, Aabb& bbox) const
 {
     bbox = bounds_;
     return true;
 }
+
+void AabbTreeNode::primitives(std::vector<const IHittable*>& primitives) const
+{
+    left_->primitives(primitives);
+
+    // Single object nodes point both children at it
+    if (right_ != left_)
+    {
+        right_->primitives(primitives);
+    }
+}
@@ -17,9 +17,19 @@ public:
     AabbTreeNode(const std::vector<std::shared_ptr<IHittable>>& srcobjects, size_t start, size_t end, double timeStart, double timeEnd, Rng& rng);
 
     bool hit(const Ray& r, double tMin, double tMax, HitRecord& hitRecord) const override;
+    uint32_t hitPacket(const RayPacket& packet, uint32_t active, double tMin, const double* tMax, HitRecord* hits) const override;
     bool boundingBox(double timeStart, double timeEnd, Aabb& bbox) const override;
+    double transmittance(const Ray& r, double tMin, double tMax) const override;
+    void primitives(std::vector<const IHittable*>& primitives) const override;
+
+    const Aabb& bounds() const { return bounds_; }
+    const IHittable* left() const { return left_.get(); }
+    const IHittable* right() const { return right_.get(); }
 
 private:
+    // hit() for a ray already known to enter bounds_
+    bool hitChildren(const Ray& r, double tMin, double tMax, HitRecord& hitRecord) const;
+
     Aabb bounds_;
     std::shared_ptr<IHittable> left_;
     std::shared_ptr<IHittable> right_;
@@ -34,7 +34,7 @@ bool AnimatedTransform::hit(const Ray& r, double tMin, double tMax, HitRecord& h
     Mat4 transform = glm::translate(p) * glm::mat4_cast(q);
     Mat4 invTransform = inverse(transform);
 
-    Ray rt{};
+    Ray rt = r;
     rt.origin = Vec3(invTransform * glm::vec4(r.origin, 1.0));
     rt.direction = Vec3(invTransform * glm::vec4(r.direction, 0.0));
 
@@ -45,6 +45,8 @@ bool AnimatedTransform::hit(const Ray& r, double tMin, double tMax, HitRecord& h
 
     hit.p = Vec3(transform * glm::vec4(hit.p, 1.0));
     hit.n = Vec3(transform * glm::vec4(hit.n, 0.0));
+    hit.dpdu = Vec3(transform * glm::vec4(hit.dpdu, 0.0));
+    hit.dpdv = Vec3(transform * glm::vec4(hit.dpdv, 0.0));
     return true;
 }
 
@@ -3,10 +3,13 @@
 #include "aa_rect.h"
 #include "flip_normals.h"
 
+#include <limits>
+
 Box::Box(const Vec3& extents, std::shared_ptr<IMaterial> material)
+    : bounds_(extents * -0.5, extents * 0.5)
 {
-    Vec3 mins = extents * -0.5;
-    Vec3 maxs = extents * 0.5;
+    Vec3 mins = bounds_.mins;
+    Vec3 maxs = bounds_.maxs;
 
     // +X
     sides_.add(std::make_shared<RectangleYZ>(mins.y, maxs.y, mins.z, maxs.z, maxs.x, material));
@@ -28,6 +31,7 @@ Box::Box(const Vec3& extents, std::shared_ptr<IMaterial> material)
 }
 
 Box::Box(const Vec3& mins, const Vec3& maxs, std::shared_ptr<IMaterial> material)
+    : bounds_(mins, maxs)
 {
     // +X
     sides_.add(std::make_shared<RectangleYZ>(mins.y, maxs.y, mins.z, maxs.z, maxs.x, material));
@@ -57,3 +61,10 @@ bool Box::boundingBox(double startTime, double endTime, Aabb& bbox) const
 {
     return sides_.boundingBox(startTime, endTime, bbox);
 }
+
+bool Box::interval(const Ray& r, double& tEnter, double& tExit) const
+{
+    tEnter = -std::numeric_limits<double>::infinity();
+    tExit = std::numeric_limits<double>::infinity();
+    return bounds_.clip(r, tEnter, tExit);
+}
@@ -15,7 +15,9 @@ public:
 
     bool hit(const Ray& r, double tMin, double tMax, HitRecord& hit) const override;
     bool boundingBox(double startTime, double endTime, Aabb& bbox) const override;
+    bool interval(const Ray& r, double& tEnter, double& tExit) const override;
 
 private:
+    Aabb bounds_;
     HittableList sides_;
 };
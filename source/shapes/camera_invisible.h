@@ -30,6 +30,31 @@ public:
         return shape_->boundingSphere(timeStart, timeEnd, center, radius);
     }
 
+    double pdfValue(const Vec3& origin, const Vec3& direction, double time) const override
+    {
+        return shape_->pdfValue(origin, direction, time);
+    }
+
+    Vec3 sampleDirection(Sampler& sampler, const Vec3& origin, double time) const override
+    {
+        return shape_->sampleDirection(sampler, origin, time);
+    }
+
+    double samplePoint(Sampler& sampler, double time, HitRecord& hit) const override
+    {
+        return shape_->samplePoint(sampler, time, hit);
+    }
+
+    void normalBounds(Vec3& axis, double& cosTheta) const override
+    {
+        shape_->normalBounds(axis, cosTheta);
+    }
+
+    bool emitter() const override
+    {
+        return shape_->emitter();
+    }
+
 private:
     std::shared_ptr<IHittable> shape_;
 };
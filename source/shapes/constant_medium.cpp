@@ -1,60 +1,56 @@
 #include "constant_medium.h"
 
-#include "core/rng.h"
+#include "core/hit_record.h"
+#include "core/sampler.h"
+
+#include <cmath>
 
 ConstantMedium::ConstantMedium(std::shared_ptr<IHittable> boundary, double density, std::shared_ptr<ITexture> albedo)
     : boundary_(boundary)
-    , negInvDensity_(-1/density)
     , phaseFunction_(std::make_shared<Isotropic>(albedo))
+    , density_(density)
 {
 }
 
 ConstantMedium::ConstantMedium(std::shared_ptr<IHittable> boundary, double density, const Vec3& color)
     : boundary_(boundary)
-    , negInvDensity_(-1/density)
     , phaseFunction_(std::make_shared<Isotropic>(color))
+    , density_(density)
 {
 }
 
 bool ConstantMedium::hit(const Ray& r, double tMin, double tMax, HitRecord& hitRecord) const
 {
-    HitRecord rec1, rec2;
-
-    if (!boundary_->hit(r, -std::numeric_limits<double>::infinity(), std::numeric_limits<double>::infinity(), rec1))
-    {
-        return false;
-    }
+    double tEnter;
+    double tExit;
 
-    if (!boundary_->hit(r, rec1.t + 0.0001, std::numeric_limits<double>::infinity(), rec2))
+    if (r.shadow || !boundary_->interval(r, tEnter, tExit))
     {
         return false;
     }
 
-    rec1.t = std::max(rec1.t, tMin);
-    rec2.t = std::min(rec2.t, tMax);
+    tEnter = std::max(std::max(tEnter, tMin), 0.0);
+    tExit = std::min(tExit, tMax);
 
-    if (rec1.t >= rec2.t)
+    if (tEnter >= tExit)
     {
         return false;
     }
 
-    if (rec1.t < 0)
-    {
-        rec1.t = 0;
-    }
-
     double rayLength = length(r.direction);
-    double distanceTravelledThroughMedium = (rec2.t - rec1.t) * rayLength;
-    double hitDistance = negInvDensity_ * std::log(r.rng->operator()());
-    
+    double distanceTravelledThroughMedium = (tExit - tEnter) * rayLength;
+    double hitDistance = -std::log(1.0 - (*r.sampler)()) / density_;
+
     if (hitDistance > distanceTravelledThroughMedium)
     {
         return false;
     }
 
-    hitRecord.t = rec1.t + hitDistance / rayLength;
+    hitRecord.t = tEnter + hitDistance / rayLength;
     hitRecord.p = r.at(hitRecord.t);
     hitRecord.n = Vec3(0,0,0);  // no normal
+    hitRecord.dpdu = Vec3(0,0,0);   // no texture coordinates
+    hitRecord.dpdv = Vec3(0,0,0);
     hitRecord.frontFace = true; // arbitrary
     hitRecord.material = phaseFunction_.get();
 
@@ -65,3 +61,24 @@ bool ConstantMedium::boundingBox(double startTime, double endTime, Aabb& bbox) c
 {
     return boundary_->boundingBox(startTime, endTime, bbox);
 }
+
+double ConstantMedium::transmittance(const Ray& r, double tMin, double tMax) const
+{
+    double tEnter;
+    double tExit;
+
+    if (!boundary_->interval(r, tEnter, tExit))
+    {
+        return 1.0;
+    }
+
+    tEnter = std::max(tEnter, tMin);
+    tExit = std::min(tExit, tMax);
+
+    if (tEnter >= tExit)
+    {
+        return 1.0;
+    }
+
+    return std::exp(-density_ * (tExit - tEnter) * length(r.direction));
+}
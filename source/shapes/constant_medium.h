@@ -15,8 +15,11 @@ public:
     bool hit(const Ray& r, double tMin, double tMax, HitRecord& hitRecord) const override;
     bool boundingBox(double startTime, double endTime, Aabb& bbox) const override;
 
+    // Homogeneous, so this is exact: exp(-density * distance)
+    double transmittance(const Ray& r, double tMin, double tMax) const override;
+
 public:
     std::shared_ptr<IHittable> boundary_;
     std::shared_ptr<IMaterial> phaseFunction_;
-    double negInvDensity_;
+    double density_;
 };
@@ -0,0 +1,15 @@
+#include "density.h"
+
+#include <algorithm>
+
+NoiseDensity::NoiseDensity(double density, double scale)
+    : density_(density)
+    , scale_(scale)
+{
+}
+
+double NoiseDensity::value(const Vec3& p) const
+{
+    // Turbulence can add up past one, clamped so maxValue() stays a bound
+    return density_ * std::min(noise_.turb(scale_ * p), 1.0);
+}
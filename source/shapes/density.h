@@ -0,0 +1,120 @@
+#pragma once
+
+#include "core/perlin.h"
+#include "core/ray.h"
+#include "core/sampler.h"
+#include "core/vec3.h"
+
+#include <cmath>
+
+// Density of a heterogeneous medium at points in world space
+class IDensity
+{
+public:
+    virtual ~IDensity() {};
+
+    virtual double value(const Vec3& p) const = 0;
+
+    // Upper bound of value() everywhere, the majorant that delta and ratio tracking step against. The closer it is to
+    // the actual densities the fewer null collisions are taken.
+    virtual double maxValue() const = 0;
+
+    // Delta tracking: finds the first real collision along r in [tMin, tMax], false if the ray gets through
+    virtual bool sampleCollision(const Ray& r, double tMin, double tMax, Sampler& sampler, double& t) const = 0;
+
+    // Ratio tracking: estimates the fraction of light that gets through [tMin, tMax] along r
+    virtual double transmittance(const Ray& r, double tMin, double tMax, Sampler& sampler) const = 0;
+};
+
+// Implements the tracking of Density with non-virtual calls to its value(), and to a forEachMajorant(r, tMin, tMax,
+// visit) that calls visit(t0, t1, majorant) for consecutive spans of [tMin, tMax] until it returns false. The default
+// is a single span bounded by maxValue(), densities with tighter bounds hide it with their own. Free flights are
+// memoryless, so tracking restarts at the start of each span with that span's majorant.
+template<typename Density>
+class TrackedDensity : public IDensity
+{
+public:
+    template<typename Visit>
+    void forEachMajorant(const Ray& r, double tMin, double tMax, Visit&& visit) const
+    {
+        double majorant = static_cast<const Density&>(*this).Density::maxValue();
+
+        if (majorant > 0.0)
+        {
+            visit(tMin, tMax, majorant);
+        }
+    }
+
+    bool sampleCollision(const Ray& r, double tMin, double tMax, Sampler& sampler, double& t) const override
+    {
+        const Density& density = static_cast<const Density&>(*this);
+        double rayLength = length(r.direction);
+        bool found = false;
+
+        density.forEachMajorant(r, tMin, tMax, [&](double t0, double t1, double majorant)
+        {
+            double invStep = 1.0 / (majorant * rayLength);
+            t = t0;
+
+            for (;;)
+            {
+                t -= std::log(1.0 - sampler()) * invStep;
+
+                if (t >= t1)
+                {
+                    return true;
+                }
+
+                if (sampler() * majorant < density.Density::value(r.at(t)))
+                {
+                    found = true;
+                    return false;
+                }
+            }
+        });
+
+        return found;
+    }
+
+    double transmittance(const Ray& r, double tMin, double tMax, Sampler& sampler) const override
+    {
+        const Density& density = static_cast<const Density&>(*this);
+        double rayLength = length(r.direction);
+        double result = 1.0;
+
+        density.forEachMajorant(r, tMin, tMax, [&](double t0, double t1, double majorant)
+        {
+            double invStep = 1.0 / (majorant * rayLength);
+            double t = t0;
+
+            for (;;)
+            {
+                t -= std::log(1.0 - sampler()) * invStep;
+
+                if (t >= t1)
+                {
+                    return true;
+                }
+
+                result *= 1.0 - density.Density::value(r.at(t)) / majorant;
+            }
+        });
+
+        return result;
+    }
+};
+
+// Wispy smoke, density scaled by Perlin turbulence at scale * p
+class NoiseDensity final : public TrackedDensity<NoiseDensity>
+{
+public:
+    NoiseDensity(double density, double scale);
+
+    double value(const Vec3& p) const override;
+    double maxValue() const override { return density_; }
+
+private:
+    Perlin noise_;
+    double density_;
+    double scale_;
+};
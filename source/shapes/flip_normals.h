@@ -31,6 +31,34 @@ public:
         return shape_->boundingSphere(startTime, endTime, center, radius);
     }
 
+    double pdfValue(const Vec3& origin, const Vec3& direction, double time) const override
+    {
+        return shape_->pdfValue(origin, direction, time);
+    }
+
+    Vec3 sampleDirection(Sampler& sampler, const Vec3& origin, double time) const override
+    {
+        return shape_->sampleDirection(sampler, origin, time);
+    }
+
+    double samplePoint(Sampler& sampler, double time, HitRecord& hit) const override
+    {
+        double inversePdf = shape_->samplePoint(sampler, time, hit);
+        hit.n = -hit.n;
+        return inversePdf;
+    }
+
+    void normalBounds(Vec3& axis, double& cosTheta) const override
+    {
+        shape_->normalBounds(axis, cosTheta);
+        axis = -axis;
+    }
+
+    bool emitter() const override
+    {
+        return shape_->emitter();
+    }
+
 private:
     std::shared_ptr<IHittable> shape_;
 };
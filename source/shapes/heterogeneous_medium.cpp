@@ -0,0 +1,79 @@
+#include "heterogeneous_medium.h"
+
+#include "core/hit_record.h"
+#include "core/sampler.h"
+
+HeterogeneousMedium::HeterogeneousMedium(std::shared_ptr<IHittable> boundary, std::shared_ptr<const IDensity> density,
+                                         std::shared_ptr<ITexture> albedo)
+    : boundary_(boundary)
+    , density_(density)
+    , phaseFunction_(std::make_shared<Isotropic>(albedo))
+    , majorant_(density->maxValue())
+{
+}
+
+HeterogeneousMedium::HeterogeneousMedium(std::shared_ptr<IHittable> boundary, std::shared_ptr<const IDensity> density,
+                                         const Vec3& color)
+    : boundary_(boundary)
+    , density_(density)
+    , phaseFunction_(std::make_shared<Isotropic>(color))
+    , majorant_(density->maxValue())
+{
+}
+
+bool HeterogeneousMedium::hit(const Ray& r, double tMin, double tMax, HitRecord& hitRecord) const
+{
+    double tEnter;
+    double tExit;
+
+    if (r.shadow || !span(r, tMin, tMax, tEnter, tExit))
+    {
+        return false;
+    }
+
+    double t;
+
+    if (!density_->sampleCollision(r, tEnter, tExit, *r.sampler, t))
+    {
+        return false;
+    }
+
+    hitRecord.t = t;
+    hitRecord.p = r.at(t);
+    hitRecord.n = Vec3(0, 0, 0);    // no normal
+    hitRecord.dpdu = Vec3(0, 0, 0); // no texture coordinates
+    hitRecord.dpdv = Vec3(0, 0, 0);
+    hitRecord.frontFace = true;     // arbitrary
+    hitRecord.material = phaseFunction_.get();
+    return true;
+}
+
+bool HeterogeneousMedium::boundingBox(double startTime, double endTime, Aabb& bbox) const
+{
+    return boundary_->boundingBox(startTime, endTime, bbox);
+}
+
+double HeterogeneousMedium::transmittance(const Ray& r, double tMin, double tMax) const
+{
+    double tEnter;
+    double tExit;
+
+    if (!span(r, tMin, tMax, tEnter, tExit))
+    {
+        return 1.0;
+    }
+
+    return density_->transmittance(r, tEnter, tExit, *r.sampler);
+}
+
+bool HeterogeneousMedium::span(const Ray& r, double tMin, double tMax, double& tEnter, double& tExit) const
+{
+    if (majorant_ <= 0.0 || !boundary_->interval(r, tEnter, tExit))
+    {
+        return false;
+    }
+
+    tEnter = std::max(std::max(tEnter, tMin), 0.0);
+    tExit = std::min(tExit, tMax);
+    return tEnter < tExit;
+}
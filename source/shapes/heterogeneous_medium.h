@@ -0,0 +1,34 @@
+#pragma once
+
+#include "shapes/density.h"
+#include "shapes/hittable.h"
+#include "materials/material.h"
+#include "materials/texture.h"
+
+#include <memory>
+
+// Participating medium whose density varies within its boundary. Camera and bounced rays find their collisions by delta
+// tracking: free flights are sampled against the majorant of each span the density reports, and each one is accepted as
+// real with probability density / majorant, the rest are null collisions the ray continues through. Shadow rays see no
+// collisions, their transmittance() is estimated by ratio tracking instead, which weights by 1 - density / majorant at
+// every step rather than making an all or nothing choice. Both are done by the density (see TrackedDensity), so each
+// ray makes one virtual call instead of one per step.
+class HeterogeneousMedium : public IHittable
+{
+public:
+    HeterogeneousMedium(std::shared_ptr<IHittable> boundary, std::shared_ptr<const IDensity> density, std::shared_ptr<ITexture> albedo);
+    HeterogeneousMedium(std::shared_ptr<IHittable> boundary, std::shared_ptr<const IDensity> density, const Vec3& color);
+
+    bool hit(const Ray& r, double tMin, double tMax, HitRecord& hitRecord) const override;
+    bool boundingBox(double startTime, double endTime, Aabb& bbox) const override;
+    double transmittance(const Ray& r, double tMin, double tMax) const override;
+
+private:
+    // The part of [tMin, tMax] inside the boundary, false if there's none or the medium is empty
+    bool span(const Ray& r, double tMin, double tMax, double& tEnter, double& tExit) const;
+
+    std::shared_ptr<IHittable> boundary_;
+    std::shared_ptr<const IDensity> density_;
+    std::shared_ptr<IMaterial> phaseFunction_;
+    double majorant_;
+};
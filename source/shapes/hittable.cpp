@@ -0,0 +1,41 @@
+#include "hittable.h"
+
+#include "core/hit_record.h"
+#include "core/ray_packet.h"
+
+#include <limits>
+
+uint32_t IHittable::hitPacket(const RayPacket& packet, uint32_t active, double tMin, const double* tMax, HitRecord* hits) const
+{
+    uint32_t result = 0;
+
+    for (uint32_t i = 0; i < packet.size; ++i)
+    {
+        if ((active & (1u << i)) && hit(packet.rays[i], tMin, tMax[i], hits[i]))
+        {
+            result |= 1u << i;
+        }
+    }
+
+    return result;
+}
+
+bool IHittable::interval(const Ray& r, double& tEnter, double& tExit) const
+{
+    HitRecord enter{};
+    HitRecord exit{};
+
+    if (!hit(r, -std::numeric_limits<double>::infinity(), std::numeric_limits<double>::infinity(), enter))
+    {
+        return false;
+    }
+
+    if (!hit(r, enter.t + 0.0001, std::numeric_limits<double>::infinity(), exit))
+    {
+        return false;
+    }
+
+    tEnter = enter.t;
+    tExit = exit.t;
+    return true;
+}
@@ -4,8 +4,13 @@
 #include "core/ray.h"
 #include "core/vec3.h"
 
+#include <cstdint>
+#include <vector>
+
 class IMaterial;
 struct HitRecord;
+struct RayPacket;
+class Sampler;
 
 class IHittable
 {
@@ -15,6 +20,19 @@ public:
     virtual bool hit(const Ray& r, double tMin, double tMax, HitRecord& hitRecord) const = 0;
     virtual bool boundingBox(double startTime, double endTime, Aabb& bbox) const = 0;
 
+    // Packet version of hit() for the rays whose bits are set in active, ray i only accepts hits closer than tMax[i].
+    // Returns the mask of rays that hit, with their records filled in exactly as hit() would. Shapes that can't cull
+    // for a whole packet keep this, which traces the rays one at a time.
+    virtual uint32_t hitPacket(const RayPacket& packet, uint32_t active, double tMin, const double* tMax, HitRecord* hits) const;
+
+    // Volume support, the span of the ray inside a closed boundary, entry and exit may be behind the origin. Convex shapes
+    // answer in one query, others find the first two crossings with hit().
+    virtual bool interval(const Ray& r, double& tEnter, double& tExit) const;
+
+    // Shadow ray support, the fraction of light along [tMin, tMax] that gets through the media inside this shape.
+    // Surfaces are opaque to hit() and let everything through here.
+    virtual double transmittance(const Ray& r, double tMin, double tMax) const { return 1.0; }
+
     virtual bool boundingSphere(double startTime, double endTime, Vec3& center, double& radius) const
     {
         Aabb bbox;
@@ -28,4 +46,28 @@ public:
         radius = length(bbox.extents() / 2.0);
         return true;
     }
+
+    // Light sampling, only implemented by shapes that can be used as emitters. The pdf is with respect to solid angle
+    // as seen from origin.
+    virtual double pdfValue(const Vec3& origin, const Vec3& direction, double time) const { return 0.0; }
+    virtual Vec3 sampleDirection(Sampler& sampler, const Vec3& origin, double time) const { return Vec3(1, 0, 0); }
+
+    // Photon emission, only implemented by shapes that can be used as emitters. Fills in a point picked uniformly by
+    // area with n and frontFace set for the side that emits, and returns the reciprocal of its area pdf (zero when
+    // not supported).
+    virtual double samplePoint(Sampler& sampler, double time, HitRecord& hit) const { return 0.0; }
+
+    // Rasterizer support, appends the pieces of this shape that can be intersected on their own. Containers recurse
+    // into their children, everything else is a single primitive.
+    virtual void primitives(std::vector<const IHittable*>& primitives) const { primitives.push_back(this); }
+
+    // Light tree support, true for shapes with an emissive material that implement the light sampling above
+    virtual bool emitter() const { return false; }
+
+    // Light tree support, the normals of the emitting side all lie within acos(cosTheta) of axis
+    virtual void normalBounds(Vec3& axis, double& cosTheta) const
+    {
+        axis = Vec3(0, 0, 1);
+        cosTheta = -1.0;
+    }
 };
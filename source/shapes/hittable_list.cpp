@@ -1,6 +1,10 @@
 #include "hittable_list.h"
 
 #include "core/hit_record.h"
+#include "core/ray_packet.h"
+#include "core/sampler.h"
+
+#include <algorithm>
 
 void HittableList::clear()
 {
@@ -30,6 +34,54 @@ bool HittableList::hit(const Ray& r, double tMin, double tMax, HitRecord& hit) c
     return result;
 }
 
+double HittableList::transmittance(const Ray& r, double tMin, double tMax) const
+{
+    double result = 1.0;
+
+    for (const auto& object : objects_)
+    {
+        result *= object->transmittance(r, tMin, tMax);
+
+        if (result <= 0.0)
+        {
+            break;
+        }
+    }
+
+    return result;
+}
+
+uint32_t HittableList::hitPacket(const RayPacket& packet, uint32_t active, double tMin, const double* tMax, HitRecord* hits) const
+{
+    uint32_t result = 0;
+    double closest[MaxPacketSize];
+    HitRecord tests[MaxPacketSize];
+
+    for (uint32_t i = 0; i < packet.size; ++i)
+    {
+        closest[i] = tMax[i];
+        tests[i] = HitRecord{};
+    }
+
+    for (const auto& object : objects_)
+    {
+        uint32_t found = object->hitPacket(packet, active, tMin, closest, tests);
+
+        for (uint32_t i = 0; i < packet.size; ++i)
+        {
+            if (found & (1u << i))
+            {
+                closest[i] = tests[i].t;
+                hits[i] = tests[i];
+            }
+        }
+
+        result |= found;
+    }
+
+    return result;
+}
+
 bool HittableList::boundingBox(double startTime, double endTime, Aabb& bbox) const
 {
     if (objects_.empty())
@@ -61,3 +113,45 @@ bool HittableList::boundingBox(double startTime, double endTime, Aabb& bbox) con
 
     return true;
 }
+
+void HittableList::primitives(std::vector<const IHittable*>& primitives) const
+{
+    for (const auto& object : objects_)
+    {
+        object->primitives(primitives);
+    }
+}
+
+double HittableList::pdfValue(const Vec3& origin, const Vec3& direction, double time) const
+{
+    if (objects_.empty())
+    {
+        return 0.0;
+    }
+
+    double sum = 0.0;
+
+    for (const auto& object : objects_)
+    {
+        sum += object->pdfValue(origin, direction, time);
+    }
+
+    return sum / double(objects_.size());
+}
+
+Vec3 HittableList::sampleDirection(Sampler& sampler, const Vec3& origin, double time) const
+{
+    size_t index = std::min(size_t(sampler.sample1D() * objects_.size()), objects_.size() - 1);
+    return objects_[index]->sampleDirection(sampler, origin, time);
+}
+
+double HittableList::samplePoint(Sampler& sampler, double time, HitRecord& hit) const
+{
+    if (objects_.empty())
+    {
+        return 0.0;
+    }
+
+    size_t index = std::min(size_t(sampler.sample1D() * objects_.size()), objects_.size() - 1);
+    return objects_[index]->samplePoint(sampler, time, hit) * double(objects_.size());
+}
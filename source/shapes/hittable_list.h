@@ -15,7 +15,17 @@ public:
     void add(std::shared_ptr<IHittable> object);
 
     bool hit(const Ray& r, double tMin, double tMax, HitRecord& hit) const override;
+    uint32_t hitPacket(const RayPacket& packet, uint32_t active, double tMin, const double* tMax, HitRecord* hits) const override;
     bool boundingBox(double startTime, double endTime, Aabb& bbox) const override;
+    double transmittance(const Ray& r, double tMin, double tMax) const override;
+    void primitives(std::vector<const IHittable*>& primitives) const override;
+
+    // Light sampling picks one of the objects uniformly
+    double pdfValue(const Vec3& origin, const Vec3& direction, double time) const override;
+    Vec3 sampleDirection(Sampler& sampler, const Vec3& origin, double time) const override;
+    double samplePoint(Sampler& sampler, double time, HitRecord& hit) const override;
+
+    bool empty() const { return objects_.empty(); }
 
     const std::vector<std::shared_ptr<IHittable>>& objects() const { return objects_; }
     std::shared_ptr<const IHittable> operator[](size_t index) const { return objects_[index]; }
@@ -0,0 +1,317 @@
+#include "light_tree.h"
+
+#include "core/hit_record.h"
+#include "core/rtiow.h"
+#include "core/sampler.h"
+#include "materials/material.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iterator>
+#include <limits>
+#include <numeric>
+
+// Points each light's power is measured at, more than one so textured emitters get a rough average
+constexpr uint32_t PowerSamples = 8;
+
+// Stand in bounds for lights that can't report any, they're effectively only found by BSDF sampling
+constexpr double UnboundedExtent = 1e30;
+
+// Median splits keep the tree this shallow for up to 2^32 lights, bounding the stack pdfValue() walks it with
+constexpr uint32_t MaxDepth = 32;
+
+// Largest double below one, keeps the rescaled number used to walk the tree in [0, 1)
+constexpr double OneMinusEpsilon = 0x1.fffffffffffffp-1;
+
+static double luminance(const Vec3& c)
+{
+    return 0.2126 * c.x + 0.7152 * c.y + 0.0722 * c.z;
+}
+
+void LightTree::build(const IHittable& scene, double timeStart, double timeEnd)
+{
+    nodes_.clear();
+    lights_.clear();
+
+    std::vector<const IHittable*> primitives;
+    scene.primitives(primitives);
+    std::copy_if(primitives.begin(), primitives.end(), std::back_inserter(lights_), [](const IHittable* primitive)
+    {
+        return primitive->emitter();
+    });
+
+    if (lights_.empty())
+    {
+        return;
+    }
+
+    std::vector<Bounds> bounds(lights_.size());
+    std::vector<double> powers(lights_.size());
+    double knownPower = 0.0;
+    uint32_t numKnown = 0;
+    RandomSampler sampler(0);
+
+    for (uint32_t i = 0; i < lights_.size(); ++i)
+    {
+        Bounds& b = bounds[i];
+
+        if (!lights_[i]->boundingBox(timeStart, timeEnd, b.box))
+        {
+            b.box = Aabb(Vec3(-UnboundedExtent), Vec3(UnboundedExtent));
+        }
+
+        lights_[i]->normalBounds(b.axis, b.cosTheta);
+
+        // A one sided diffuse emitter sends out pi times its area times its radiance
+        double power = 0.0;
+        bool known = true;
+
+        for (uint32_t s = 0; s < PowerSamples && known; ++s)
+        {
+            sampler.startPixelSample(i, 0, s);
+            HitRecord hit{};
+            double area = lights_[i]->samplePoint(sampler, timeStart, hit);
+            known = (area > 0.0);
+            power += known ? luminance(hit.material->emitted(hit)) * area * pi / PowerSamples : 0.0;
+        }
+
+        powers[i] = known ? power : -1.0;
+        knownPower += known ? power : 0.0;
+        numKnown += known ? 1 : 0;
+    }
+
+    // Lights that can't be sampled by area get the average power of the rest
+    double averagePower = (numKnown > 0) ? knownPower / numKnown : 1.0;
+
+    for (uint32_t i = 0; i < lights_.size(); ++i)
+    {
+        powers[i] = (powers[i] < 0.0) ? averagePower : powers[i];
+        bounds[i].power = powers[i];
+    }
+
+    powerDistribution_ = Distribution1D(powers.data(), powers.size());
+
+    std::vector<uint32_t> indices(lights_.size());
+    std::iota(indices.begin(), indices.end(), 0);
+    nodes_.reserve(lights_.size() * 2 - 1);
+    buildNode(indices, 0, indices.size(), bounds);
+}
+
+uint32_t LightTree::buildNode(std::vector<uint32_t>& indices, size_t begin, size_t end, const std::vector<Bounds>& bounds)
+{
+    uint32_t node = uint32_t(nodes_.size());
+    nodes_.push_back(Node{});
+
+    if (end - begin == 1)
+    {
+        nodes_[node] = Node{ bounds[indices[begin]], indices[begin], true };
+        return node;
+    }
+
+    // Split at the median along the axis the light centres spread furthest on
+    Vec3 mins(std::numeric_limits<double>::infinity());
+    Vec3 maxs(-std::numeric_limits<double>::infinity());
+
+    for (size_t i = begin; i < end; ++i)
+    {
+        Vec3 center = (bounds[indices[i]].box.mins + bounds[indices[i]].box.maxs) * 0.5;
+        mins = glm::min(mins, center);
+        maxs = glm::max(maxs, center);
+    }
+
+    Vec3 extents = maxs - mins;
+    int axis = (extents.x > extents.y) ? 0 : 1;
+    axis = (extents[axis] > extents.z) ? axis : 2;
+
+    size_t mid = (begin + end) / 2;
+    std::nth_element(indices.begin() + begin, indices.begin() + mid, indices.begin() + end, [&bounds, axis](uint32_t a, uint32_t b)
+    {
+        return bounds[a].box.mins[axis] + bounds[a].box.maxs[axis] < bounds[b].box.mins[axis] + bounds[b].box.maxs[axis];
+    });
+
+    buildNode(indices, begin, mid, bounds);
+    uint32_t second = buildNode(indices, mid, end, bounds);
+    nodes_[node] = Node{ merge(nodes_[node + 1].bounds, nodes_[second].bounds), second, false };
+    return node;
+}
+
+LightTree::Bounds LightTree::merge(const Bounds& a, const Bounds& b)
+{
+    Bounds result;
+    result.box = a.box.makeUnion(b.box);
+    result.power = a.power + b.power;
+
+    // Smallest cone holding both cones
+    double thetaA = std::acos(clamp(a.cosTheta, -1.0, 1.0));
+    double thetaB = std::acos(clamp(b.cosTheta, -1.0, 1.0));
+    double thetaD = std::acos(clamp(dot(a.axis, b.axis), -1.0, 1.0));
+
+    if (std::min(thetaD + thetaB, pi) <= thetaA)
+    {
+        result.axis = a.axis;
+        result.cosTheta = a.cosTheta;
+        return result;
+    }
+
+    if (std::min(thetaD + thetaA, pi) <= thetaB)
+    {
+        result.axis = b.axis;
+        result.cosTheta = b.cosTheta;
+        return result;
+    }
+
+    double theta = (thetaA + thetaD + thetaB) * 0.5;
+    Vec3 rotationAxis = cross(a.axis, b.axis);
+
+    if (theta >= pi || length2(rotationAxis) <= 0.0)
+    {
+        result.axis = a.axis;
+        result.cosTheta = -1.0;
+        return result;
+    }
+
+    // Rotate a's axis towards b's so the new cone just reaches the far side of a
+    double rotation = theta - thetaA;
+    rotationAxis = normalize(rotationAxis);
+    result.axis = normalize(a.axis * std::cos(rotation) + cross(rotationAxis, a.axis) * std::sin(rotation));
+    result.cosTheta = std::cos(theta);
+    return result;
+}
+
+double LightTree::importance(const Bounds& bounds, const Vec3& p)
+{
+    Vec3 center = (bounds.box.mins + bounds.box.maxs) * 0.5;
+    Vec3 toPoint = p - center;
+    double distanceSquared = length2(toPoint);
+    double radiusSquared = length2(bounds.box.extents()) * 0.25;
+
+    // Smallest angle between a normal in the cone and the direction from somewhere in the box towards p
+    double cosW = (distanceSquared > 0.0) ? dot(bounds.axis, toPoint) / std::sqrt(distanceSquared) : 1.0;
+    double sinW = std::sqrt(std::max(0.0, 1.0 - cosW * cosW));
+    double cosO = bounds.cosTheta;
+    double sinO = std::sqrt(std::max(0.0, 1.0 - cosO * cosO));
+    double cosB = (distanceSquared > radiusSquared) ? std::sqrt(1.0 - radiusSquared / distanceSquared) : -1.0;
+    double sinB = std::sqrt(std::max(0.0, 1.0 - cosB * cosB));
+
+    double cosX = (cosW > cosO) ? 1.0 : cosW * cosO + sinW * sinO;
+    double sinX = std::sqrt(std::max(0.0, 1.0 - cosX * cosX));
+    double cosP = (cosX > cosB) ? 1.0 : cosX * cosB + sinX * sinB;
+
+    // Diffuse emitters send nothing past 90 degrees from their normal
+    if (cosP <= 0.0)
+    {
+        return 0.0;
+    }
+
+    return bounds.power * cosP / std::max(distanceSquared, radiusSquared);
+}
+
+// Probability of descending into the first child, with an even split when neither can light p so that sampling and
+// pdfValue() still agree
+static double firstChildProbability(double first, double second)
+{
+    return (first + second > 0.0) ? first / (first + second) : 0.5;
+}
+
+double LightTree::pdfValue(const Vec3& origin, const Vec3& direction, double time) const
+{
+    if (nodes_.empty())
+    {
+        return 0.0;
+    }
+
+    struct Item
+    {
+        uint32_t node;
+        double probability;
+    };
+
+    // Only lights whose bounds the ray passes through can have a non zero pdf in its direction
+    Ray ray(origin, direction, time, false, nullptr);
+    // Each step pops one node and pushes at most its two children, so the stack never holds more than one node per level
+    Item stack[MaxDepth + 1];
+    uint32_t size = 0;
+    stack[size++] = { 0, 1.0 };
+    double pdf = 0.0;
+
+    while (size > 0)
+    {
+        Item item = stack[--size];
+        const Node& node = nodes_[item.node];
+
+        if (!node.bounds.box.hit(ray, 0.001, std::numeric_limits<double>::infinity()))
+        {
+            continue;
+        }
+
+        if (node.leaf)
+        {
+            pdf += item.probability * lights_[node.index]->pdfValue(origin, direction, time);
+            continue;
+        }
+
+        double p = firstChildProbability(importance(nodes_[item.node + 1].bounds, origin), importance(nodes_[node.index].bounds, origin));
+
+        if (p > 0.0)
+        {
+            stack[size++] = { item.node + 1, item.probability * p };
+        }
+
+        if (p < 1.0)
+        {
+            stack[size++] = { node.index, item.probability * (1.0 - p) };
+        }
+    }
+
+    return pdf;
+}
+
+Vec3 LightTree::sampleDirection(Sampler& sampler, const Vec3& origin, double time) const
+{
+    if (nodes_.empty())
+    {
+        return Vec3(1, 0, 0);
+    }
+
+    // One number picks the whole path down the tree, rescaled after each choice
+    double u = sampler.sample1D();
+    uint32_t node = 0;
+
+    while (!nodes_[node].leaf)
+    {
+        double p = firstChildProbability(importance(nodes_[node + 1].bounds, origin), importance(nodes_[nodes_[node].index].bounds, origin));
+
+        if (u < p)
+        {
+            u = std::min(u / p, OneMinusEpsilon);
+            node = node + 1;
+        }
+        else
+        {
+            u = std::min((u - p) / (1.0 - p), OneMinusEpsilon);
+            node = nodes_[node].index;
+        }
+    }
+
+    return lights_[nodes_[node].index]->sampleDirection(sampler, origin, time);
+}
+
+double LightTree::samplePoint(Sampler& sampler, double time, HitRecord& hit) const
+{
+    if (lights_.empty())
+    {
+        return 0.0;
+    }
+
+    double pdf;
+    size_t index;
+    powerDistribution_.sampleContinuous(sampler.sample1D(), pdf, index);
+    double probability = pdf / double(lights_.size());
+
+    if (probability <= 0.0)
+    {
+        return 0.0;
+    }
+
+    return lights_[index]->samplePoint(sampler, time, hit) / probability;
+}
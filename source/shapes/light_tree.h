@@ -0,0 +1,52 @@
+#pragma once
+
+#include "core/aabb.h"
+#include "core/distribution.h"
+#include "shapes/hittable.h"
+
+#include <vector>
+
+// Emitters grouped by position, orientation and power (Conty Estevez and Kulla 2018, "Importance Sampling of Many
+// Lights with Adaptive Tree Splitting"). Light sampling walks down the tree, picking children by a bound on the light
+// they could send to the shading point, so its cost grows with the log of the number of lights rather than linearly.
+class LightTree
+{
+public:
+    // Gathers every emitter in scene, call once the scene is complete. The scene has to outlive the tree.
+    void build(const IHittable& scene, double timeStart, double timeEnd);
+
+    bool empty() const { return lights_.empty(); }
+
+    // Same contract as light sampling with IHittable
+    double pdfValue(const Vec3& origin, const Vec3& direction, double time) const;
+    Vec3 sampleDirection(Sampler& sampler, const Vec3& origin, double time) const;
+
+    // Picks a light in proportion to its power, for photon emission
+    double samplePoint(Sampler& sampler, double time, HitRecord& hit) const;
+
+private:
+    struct Bounds
+    {
+        Aabb box;
+        Vec3 axis;          // Every emitting normal lies within acos(cosTheta) of axis
+        double cosTheta;
+        double power;
+    };
+
+    // Nodes are stored depth first, so an interior node's first child follows it
+    struct Node
+    {
+        Bounds bounds;
+        uint32_t index;     // Light for leaves, second child otherwise
+        bool leaf;
+    };
+
+    static Bounds merge(const Bounds& a, const Bounds& b);
+    static double importance(const Bounds& bounds, const Vec3& p);
+
+    uint32_t buildNode(std::vector<uint32_t>& indices, size_t begin, size_t end, const std::vector<Bounds>& bounds);
+
+    std::vector<const IHittable*> lights_;
+    std::vector<Node> nodes_;
+    Distribution1D powerDistribution_;
+};
@@ -1,8 +1,12 @@
 #include "sphere.h"
 
+#include "core/hit_record.h"
 #include "core/rtiow.h"
+#include "core/sampler.h"
+#include "core/sampling.h"
 
 #include <cmath>
+#include <limits>
 
 bool Sphere::hit(const Ray& r, double tMin, double tMax, HitRecord& hit) const
 {
@@ -41,6 +45,12 @@ bool Sphere::hit(const Ray& r, double tMin, double tMax, HitRecord& hit) const
     hit.u = phi / (2*pi);
     hit.v = theta / pi;
 
+    // Around the axis and along the meridian, which has no direction at the poles
+    double sinTheta = std::sqrt(surfaceNormal.x * surfaceNormal.x + surfaceNormal.z * surfaceNormal.z);
+    hit.dpdu = Vec3(surfaceNormal.z, 0.0, -surfaceNormal.x) * (2.0 * pi * radius);
+    hit.dpdv = (sinTheta > 0.0) ? Vec3(-surfaceNormal.y * surfaceNormal.x / sinTheta, sinTheta, -surfaceNormal.y * surfaceNormal.z / sinTheta) * (pi * radius)
+                                : Vec3(pi * radius, 0.0, 0.0);
+
     return true;
 }
 
@@ -51,3 +61,85 @@ bool Sphere::boundingBox(double timeStart, double timeEnd, Aabb& bbox) const
     bbox.maxs = center + extents;
     return true;
 }
+
+bool Sphere::interval(const Ray& r, double& tEnter, double& tExit) const
+{
+    Vec3 oc = r.origin - center;
+    double a = dot(r.direction, r.direction);
+    double halfb = dot(oc, r.direction);
+    double c = dot(oc, oc) - radius * radius;
+    double discriminant = halfb * halfb - a * c;
+
+    if (discriminant <= 0)
+    {
+        return false;
+    }
+
+    double sqrtd = std::sqrt(discriminant);
+    tEnter = (-halfb - sqrtd) / a;
+    tExit = (-halfb + sqrtd) / a;
+    return true;
+}
+
+double Sphere::pdfValue(const Vec3& origin, const Vec3& direction, double time) const
+{
+    HitRecord hit{};
+
+    if (!this->hit(Ray(origin, direction, time, false, nullptr), 0.001, std::numeric_limits<double>::infinity(), hit))
+    {
+        return 0.0;
+    }
+
+    double radiusSquared = radius * radius;
+    double distanceSquared = length2(center - origin);
+
+    if (distanceSquared <= radiusSquared)
+    {
+        // Inside the sphere, so sampleDirection() falls back to uniform area sampling
+        double cosine = std::abs(dot(normalize(direction), hit.n));
+        return hit.t * hit.t * length2(direction) / (cosine * 4.0 * pi * radiusSquared);
+    }
+
+    double cosThetaMax = std::sqrt(1.0 - radiusSquared / distanceSquared);
+    return 1.0 / (2.0 * pi * (1.0 - cosThetaMax));
+}
+
+Vec3 Sphere::sampleDirection(Sampler& sampler, const Vec3& origin, double time) const
+{
+    Vec3 toCenter = center - origin;
+    double radiusSquared = radius * radius;
+    double distanceSquared = length2(toCenter);
+
+    if (distanceSquared <= radiusSquared)
+    {
+        return normalize(center + squareToUniformSphere(sampler(), sampler()) * std::abs(radius) - origin);
+    }
+
+    // Uniformly sample the cone of directions subtended by the sphere
+    double cosThetaMax = std::sqrt(1.0 - radiusSquared / distanceSquared);
+    double cosTheta = 1.0 - sampler() * (1.0 - cosThetaMax);
+    double sinTheta = std::sqrt(std::max(0.0, 1.0 - cosTheta * cosTheta));
+    double phi = 2.0 * pi * sampler();
+
+    Vec3 w = toCenter / std::sqrt(distanceSquared);
+    Vec3 u, v;
+    makeBasis(w, u, v);
+    return u * (std::cos(phi) * sinTheta) + v * (std::sin(phi) * sinTheta) + w * cosTheta;
+}
+
+double Sphere::samplePoint(Sampler& sampler, double time, HitRecord& hit) const
+{
+    // Negative radii flip the normal to make hollow spheres, so the point is placed with the same convention
+    hit.n = squareToUniformSphere(sampler(), sampler());
+    hit.p = center + hit.n * std::abs(radius);
+    hit.n = (radius < 0.0) ? -hit.n : hit.n;
+    hit.frontFace = true;
+    hit.material = material.get();
+
+    double theta = std::acos(-hit.n.y);
+    double phi = std::atan2(-hit.n.z, hit.n.x) + pi;
+    hit.u = phi / (2*pi);
+    hit.v = theta / pi;
+
+    return 4.0 * pi * radius * radius;
+}
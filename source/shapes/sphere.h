@@ -18,4 +18,9 @@ public:
 
     bool hit(const Ray& r, double tMin, double tMax, HitRecord& hit) const override;
     bool boundingBox(double timeStart, double timeEnd, Aabb& bbox) const override;
+    bool interval(const Ray& r, double& tEnter, double& tExit) const override;
+    double pdfValue(const Vec3& origin, const Vec3& direction, double time) const override;
+    Vec3 sampleDirection(Sampler& sampler, const Vec3& origin, double time) const override;
+    double samplePoint(Sampler& sampler, double time, HitRecord& hit) const override;
+    bool emitter() const override { return material && material->kind() == MaterialKind::LightSource; }
 };
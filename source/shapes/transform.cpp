@@ -4,7 +4,7 @@
 
 bool Transform::hit(const Ray& r, double tMin, double tMax, HitRecord& hit) const
 {
-    Ray rt;
+    Ray rt = r;
     rt.origin = Vec3(invTransform_ * glm::vec4(r.origin, 1.0));
     rt.direction = Vec3(invTransform_ * glm::vec4(r.direction, 0.0));
 
@@ -15,9 +15,20 @@ bool Transform::hit(const Ray& r, double tMin, double tMax, HitRecord& hit) cons
 
     hit.p = Vec3(transform_ * glm::vec4(hit.p, 1.0));
     hit.n = Vec3(transform_ * glm::vec4(hit.n, 0.0));
+    hit.dpdu = Vec3(transform_ * glm::vec4(hit.dpdu, 0.0));
+    hit.dpdv = Vec3(transform_ * glm::vec4(hit.dpdv, 0.0));
     return true;
 }
 
+bool Transform::interval(const Ray& r, double& tEnter, double& tExit) const
+{
+    // The direction is transformed along with the origin, so distances along the ray are the same in both spaces
+    Ray rt = r;
+    rt.origin = Vec3(invTransform_ * glm::vec4(r.origin, 1.0));
+    rt.direction = Vec3(invTransform_ * glm::vec4(r.direction, 0.0));
+    return shape_->interval(rt, tEnter, tExit);
+}
+
 bool Transform::boundingBox(double timeStart, double timeEnd, Aabb& bbox) const
 {
     Aabb shapeBbox{};
@@ -54,3 +65,17 @@ bool Transform::boundingSphere(double timeStart, double timeEnd, Vec3& center, d
     center = Vec3(transform_ * glm::vec4(center, 1.0));
     return true;
 }
+
+double Transform::pdfValue(const Vec3& origin, const Vec3& direction, double time) const
+{
+    Vec3 localOrigin = Vec3(invTransform_ * glm::vec4(origin, 1.0));
+    Vec3 localDirection = Vec3(invTransform_ * glm::vec4(direction, 0.0));
+    return shape_->pdfValue(localOrigin, localDirection, time);
+}
+
+Vec3 Transform::sampleDirection(Sampler& sampler, const Vec3& origin, double time) const
+{
+    Vec3 localOrigin = Vec3(invTransform_ * glm::vec4(origin, 1.0));
+    Vec3 localDirection = shape_->sampleDirection(sampler, localOrigin, time);
+    return normalize(Vec3(transform_ * glm::vec4(localDirection, 0.0)));
+}
@@ -18,6 +18,12 @@ public:
     bool hit(const Ray& r, double tMin, double tMax, HitRecord& hit) const override;
     bool boundingBox(double timeStart, double timeEnd, Aabb& bbox) const override;
     bool boundingSphere(double timeStart, double timeEnd, Vec3& center, double& radius) const override;
+    bool interval(const Ray& r, double& tEnter, double& tExit) const override;
+
+    // Solid angle pdfs are only preserved by rigid transforms
+    double pdfValue(const Vec3& origin, const Vec3& direction, double time) const override;
+    Vec3 sampleDirection(Sampler& sampler, const Vec3& origin, double time) const override;
+    bool emitter() const override { return shape_->emitter(); }
 
 private:
     Mat4 transform_;
@@ -0,0 +1,196 @@
+#include "voxel_grid.h"
+
+#include "core/ray.h"
+#include "core/rtiow.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+VoxelGrid::VoxelGrid(const CreateInfo& createInfo)
+    : info_(createInfo)
+{
+    for (int a = 0; a < 3; ++a)
+    {
+        bricks_[a] = std::max((info_.resolution[a] + BrickSize - 1) / BrickSize, 1u);
+    }
+
+    brickIndices_.assign(size_t(bricks_[0]) * bricks_[1] * bricks_[2], EmptyBrick);
+    buildMajorants();
+}
+
+void VoxelGrid::fill(const std::function<double(const Vec3& p)>& density)
+{
+    std::fill(brickIndices_.begin(), brickIndices_.end(), EmptyBrick);
+    voxels_.clear();
+    float brick[BrickVoxels];
+    size_t b = 0;
+
+    for (uint32_t bz = 0; bz < bricks_[2]; ++bz)
+    {
+        for (uint32_t by = 0; by < bricks_[1]; ++by)
+        {
+            for (uint32_t bx = 0; bx < bricks_[0]; ++bx, ++b)
+            {
+                bool empty = true;
+                uint32_t v = 0;
+
+                for (uint32_t z = bz * BrickSize; z < (bz + 1) * BrickSize; ++z)
+                {
+                    for (uint32_t y = by * BrickSize; y < (by + 1) * BrickSize; ++y)
+                    {
+                        for (uint32_t x = bx * BrickSize; x < (bx + 1) * BrickSize; ++x, ++v)
+                        {
+                            brick[v] = 0.0f;
+
+                            if (x < info_.resolution[0] && y < info_.resolution[1] && z < info_.resolution[2])
+                            {
+                                Vec3 center = info_.mins + Vec3(x + 0.5, y + 0.5, z + 0.5) * info_.voxelSize;
+                                brick[v] = float(std::max(density(center), 0.0));
+                                empty = empty && brick[v] == 0.0f;
+                            }
+                        }
+                    }
+                }
+
+                if (!empty)
+                {
+                    brickIndices_[b] = uint32_t(voxels_.size() / BrickVoxels);
+                    voxels_.insert(voxels_.end(), brick, brick + BrickVoxels);
+                }
+            }
+        }
+    }
+
+    buildMajorants();
+}
+
+double VoxelGrid::value(const Vec3& p) const
+{
+    // Voxel values sit at voxel centers
+    Vec3 q = (p - info_.mins) / info_.voxelSize - Vec3(0.5, 0.5, 0.5);
+    Vec3 base(std::floor(q.x), std::floor(q.y), std::floor(q.z));
+    Vec3 f = q - base;
+    int32_t x = int32_t(base.x);
+    int32_t y = int32_t(base.y);
+    int32_t z = int32_t(base.z);
+
+    double c00 = lerp(double(voxel(x, y, z)), double(voxel(x + 1, y, z)), f.x);
+    double c10 = lerp(double(voxel(x, y + 1, z)), double(voxel(x + 1, y + 1, z)), f.x);
+    double c01 = lerp(double(voxel(x, y, z + 1)), double(voxel(x + 1, y, z + 1)), f.x);
+    double c11 = lerp(double(voxel(x, y + 1, z + 1)), double(voxel(x + 1, y + 1, z + 1)), f.x);
+    return lerp(lerp(c00, c10, f.y), lerp(c01, c11, f.y), f.z);
+}
+
+double VoxelGrid::maxValue() const
+{
+    return majorants_.back()[0];
+}
+
+Aabb VoxelGrid::bounds() const
+{
+    Vec3 size(info_.resolution[0], info_.resolution[1], info_.resolution[2]);
+    return Aabb(info_.mins, info_.mins + size * info_.voxelSize);
+}
+
+float VoxelGrid::voxel(int32_t x, int32_t y, int32_t z) const
+{
+    if (x < 0 || y < 0 || z < 0 || x >= int32_t(info_.resolution[0]) || y >= int32_t(info_.resolution[1]) ||
+        z >= int32_t(info_.resolution[2]))
+    {
+        return 0.0f;
+    }
+
+    size_t b = (size_t(z / BrickSize) * bricks_[1] + y / BrickSize) * bricks_[0] + x / BrickSize;
+    uint32_t index = brickIndices_[b];
+
+    if (index == EmptyBrick)
+    {
+        return 0.0f;
+    }
+
+    return voxels_[size_t(index) * BrickVoxels + ((z % BrickSize) * BrickSize + y % BrickSize) * BrickSize + x % BrickSize];
+}
+
+void VoxelGrid::buildMajorants()
+{
+    majorants_.clear();
+    levelCells_.assign(bricks_, bricks_ + 3);
+    std::vector<float> level(brickIndices_.size(), 0.0f);
+    size_t b = 0;
+
+    // Interpolation reaches half a voxel past a brick's edges, so its majorant covers one voxel of its neighbours too
+    for (uint32_t bz = 0; bz < bricks_[2]; ++bz)
+    {
+        for (uint32_t by = 0; by < bricks_[1]; ++by)
+        {
+            for (uint32_t bx = 0; bx < bricks_[0]; ++bx, ++b)
+            {
+                int32_t x0 = int32_t(bx * BrickSize);
+                int32_t y0 = int32_t(by * BrickSize);
+                int32_t z0 = int32_t(bz * BrickSize);
+                bool nearVoxels = false;
+
+                for (uint32_t n = 0; n < 27 && !nearVoxels; ++n)
+                {
+                    int32_t nx = int32_t(bx) + int32_t(n % 3) - 1;
+                    int32_t ny = int32_t(by) + int32_t(n / 3 % 3) - 1;
+                    int32_t nz = int32_t(bz) + int32_t(n / 9) - 1;
+
+                    if (nx >= 0 && ny >= 0 && nz >= 0 && nx < int32_t(bricks_[0]) && ny < int32_t(bricks_[1]) &&
+                        nz < int32_t(bricks_[2]))
+                    {
+                        nearVoxels = brickIndices_[(size_t(nz) * bricks_[1] + ny) * bricks_[0] + nx] != EmptyBrick;
+                    }
+                }
+
+                if (!nearVoxels)
+                {
+                    continue;
+                }
+
+                for (int32_t z = z0 - 1; z <= z0 + int32_t(BrickSize); ++z)
+                {
+                    for (int32_t y = y0 - 1; y <= y0 + int32_t(BrickSize); ++y)
+                    {
+                        for (int32_t x = x0 - 1; x <= x0 + int32_t(BrickSize); ++x)
+                        {
+                            level[b] = std::max(level[b], voxel(x, y, z));
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    majorants_.push_back(std::move(level));
+
+    for (;;)
+    {
+        const uint32_t* cells = &levelCells_[levelCells_.size() - 3];
+
+        if (cells[0] == 1 && cells[1] == 1 && cells[2] == 1)
+        {
+            break;
+        }
+
+        uint32_t coarse[3] = { (cells[0] + 1) / 2, (cells[1] + 1) / 2, (cells[2] + 1) / 2 };
+        const std::vector<float>& fine = majorants_.back();
+        std::vector<float> next(size_t(coarse[0]) * coarse[1] * coarse[2], 0.0f);
+
+        for (uint32_t z = 0; z < cells[2]; ++z)
+        {
+            for (uint32_t y = 0; y < cells[1]; ++y)
+            {
+                for (uint32_t x = 0; x < cells[0]; ++x)
+                {
+                    float& m = next[(size_t(z / 2) * coarse[1] + y / 2) * coarse[0] + x / 2];
+                    m = std::max(m, fine[(size_t(z) * cells[1] + y) * cells[0] + x]);
+                }
+            }
+        }
+
+        levelCells_.insert(levelCells_.end(), coarse, coarse + 3);
+        majorants_.push_back(std::move(next));
+    }
+}
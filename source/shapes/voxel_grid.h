@@ -0,0 +1,139 @@
+#pragma once
+
+#include "core/aabb.h"
+#include "shapes/density.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <vector>
+
+// Sparse density grid for HeterogeneousMedium. Voxels are stored in 8x8x8 bricks, only bricks with a non-zero voxel are
+// allocated and the rest cost one index in the brick table. Each brick keeps a majorant for the densities it can
+// interpolate, and a pyramid of coarser levels keeps the maximum of each 2x2x2 group of cells below it. forEachMajorant()
+// walks the brick table with a DDA that climbs to the coarsest empty cell around it to skip empty space in one step, and
+// reports a span per non-empty brick.
+class VoxelGrid final : public TrackedDensity<VoxelGrid>
+{
+public:
+    struct CreateInfo
+    {
+        Vec3 mins;              // World space corner of the grid
+        double voxelSize;
+        uint32_t resolution[3]; // Voxels along each axis
+    };
+
+    VoxelGrid(const CreateInfo& createInfo);
+
+    // Sets every voxel to density(center of the voxel), bricks that come out zero throughout aren't kept
+    void fill(const std::function<double(const Vec3& p)>& density);
+
+    // Trilinear interpolation between voxel centers, zero outside the grid
+    double value(const Vec3& p) const override;
+    double maxValue() const override;
+
+    template<typename Visit>
+    void forEachMajorant(const Ray& r, double tMin, double tMax, Visit&& visit) const;
+
+    Aabb bounds() const;
+    size_t allocatedBricks() const { return voxels_.size() / BrickVoxels; }
+    size_t totalBricks() const { return brickIndices_.size(); }
+
+private:
+    static constexpr uint32_t BrickSize = 8;
+    static constexpr uint32_t BrickVoxels = BrickSize * BrickSize * BrickSize;
+    static constexpr uint32_t EmptyBrick = UINT32_MAX;
+
+    float voxel(int32_t x, int32_t y, int32_t z) const;
+    void buildMajorants();
+
+    CreateInfo info_;
+    uint32_t bricks_[3];                            // Bricks along each axis
+    std::vector<uint32_t> brickIndices_;            // Brick table, the index of each brick's voxels or EmptyBrick
+    std::vector<float> voxels_;                     // BrickVoxels per allocated brick
+    std::vector<std::vector<float>> majorants_;     // Level 0 has one per brick, each level halves the one below
+    std::vector<uint32_t> levelCells_;              // Cells along each axis of each level, 3 per level
+};
+
+template<typename Visit>
+void VoxelGrid::forEachMajorant(const Ray& r, double tMin, double tMax, Visit&& visit) const
+{
+    if (!bounds().clip(r, tMin, tMax))
+    {
+        return;
+    }
+
+    double brickWidth = info_.voxelSize * BrickSize;
+    Vec3 start = (r.at(tMin) - info_.mins) / brickWidth;
+    int32_t cell[3];
+
+    for (int a = 0; a < 3; ++a)
+    {
+        cell[a] = std::clamp(int32_t(std::floor(start[a])), 0, int32_t(bricks_[a]) - 1);
+    }
+
+    uint32_t numLevels = uint32_t(majorants_.size());
+    double t = tMin;
+
+    while (t < tMax)
+    {
+        auto majorant = [&](uint32_t level)
+        {
+            const uint32_t* cells = &levelCells_[level * 3];
+            size_t index = (size_t(cell[2] >> level) * cells[1] + (cell[1] >> level)) * cells[0] + (cell[0] >> level);
+            return majorants_[level][index];
+        };
+
+        // Empty bricks are skipped along with the largest empty cell of the pyramid that contains them
+        double m = majorant(0);
+        uint32_t level = 0;
+
+        while (m == 0.0 && level + 1 < numLevels && majorant(level + 1) == 0.0)
+        {
+            ++level;
+        }
+
+        double cellWidth = brickWidth * double(1u << level);
+        double tExit = std::numeric_limits<double>::infinity();
+        int axis = 0;
+
+        for (int a = 0; a < 3; ++a)
+        {
+            if (r.direction[a] != 0.0)
+            {
+                int32_t c = (cell[a] >> level) + (r.direction[a] > 0.0 ? 1 : 0);
+                double tAxis = (info_.mins[a] + c * cellWidth - r.origin[a]) / r.direction[a];
+
+                if (tAxis < tExit)
+                {
+                    tExit = tAxis;
+                    axis = a;
+                }
+            }
+        }
+
+        double t1 = std::min(tExit, tMax);
+
+        if (m > 0.0 && t1 > t && !visit(t, t1, m))
+        {
+            return;
+        }
+
+        if (tExit >= tMax)
+        {
+            return;
+        }
+
+        // Cell indices are stepped as integers so rounding can't stall or skip a brick
+        t = std::max(t, tExit);
+        int32_t c = cell[axis] >> level;
+        cell[axis] = (r.direction[axis] > 0.0) ? (c + 1) << level : (c << level) - 1;
+
+        if (cell[axis] < 0 || cell[axis] >= int32_t(bricks_[axis]))
+        {
+            return;
+        }
+    }
+}